@@ -70,6 +70,9 @@ const char* const BDOS_CALLS[] PROGMEM = {BDOS_00, BDOS_01, BDOS_02, BDOS_03, BD
                                          };
 
 BDOS::BDOS(I8080 * cpu, RAM * ram, DRIVE * drv, BIOS * bios): cpu(cpu), ram(ram), drv(drv), bios(bios) {
+#ifdef BDOS_FILES
+  oftClear();
+#endif
 }
 
 BDOS::~BDOS() {
@@ -133,6 +136,9 @@ uint8_t BDOS::call(uint16_t port) {
   switch (func) {
     case 0x00:  // WBOOT
       // System reset
+#ifdef BDOS_FILES
+      oftClear();
+#endif
       bios->wboot();
       break;
 
@@ -189,6 +195,7 @@ uint8_t BDOS::call(uint16_t port) {
       // Function to set the i/o byte.
       bios->ioByte(eparam);
       ram->setByte(IOBYTE, eparam);
+      cpu->invalidate(IOBYTE, 1);
       break;
 
     case 0x09:  // PRTSTR
@@ -271,6 +278,7 @@ uint8_t BDOS::call(uint16_t port) {
       }
       // Save the number of characters read
       ram->setByte(w, count);
+      cpu->invalidate(w, count + 1);
       // Gives a visual feedback that read ended
       bios->conout('\r');
       break;
@@ -293,6 +301,7 @@ uint8_t BDOS::call(uint16_t port) {
       rwoVector = 0x0000;   // Clear write protect vector
       logVector = 0x0001;   // Reset log in vector
       ramDMA = TBUFF;       // Setup default DMA address
+      drv->rescan();        // Find the drives again
       // Check if there is a $$$.SUB on the boot disk
       result = drv->checkSUB(cDrive, cUser);
       break;
@@ -332,6 +341,10 @@ uint8_t BDOS::call(uint16_t port) {
         if (drv->open(fName)) {
           // Get the file size (in blocks)
           fSize = drv->fileSize(fName) / sizBK;
+#ifdef BDOS_FILES
+          // Keep the open file
+          oftSave();
+#endif
           // Reset S1 and S2
           fcb.s1 = 0x00;
           fcb.s2 = 0x80; // set unmodified flag
@@ -355,6 +368,11 @@ uint8_t BDOS::call(uint16_t port) {
       readFCB();
       // Select the drive
       if (selDrive(fcb.dr)) {
+#ifdef BDOS_FILES
+        // Forget the open file
+        fcb2cname(fcb, fName);
+        oftDrop(fName);
+#endif
         // Check if the file has been modifed
         if (!(fcb.s2 & 0x80)) {
           // Check if the drive is write protected
@@ -369,9 +387,9 @@ uint8_t BDOS::call(uint16_t port) {
             if (ramFCB == BATCHFCB)
               // Truncate it to fcb.rc CP/M records so SUBMIT.COM can work
               drv->truncate(fName, fcb.rc);
-            // Close the file
-            drv->close(fName);
-            result = 0x00;
+            // Close the file, the buffered records may fail to be written
+            if (drv->close(fName))
+              result = 0x00;
           }
           else
             // Return error 4 if write protected
@@ -480,6 +498,9 @@ uint8_t BDOS::call(uint16_t port) {
           while (result != 0xFF) {
             // Delete it, the full file name starts at FNHOST
             drv->remove(fName);
+#ifdef BDOS_FILES
+            oftDrop(fName);
+#endif
             // Find the next one
             result = drv->findNext(fName, fSize);
           }
@@ -502,12 +523,11 @@ uint8_t BDOS::call(uint16_t port) {
       // Get position from FCB
       fRec = (fcb.s2 & mskS2) * recS2 + fcb.ex * recEX + fcb.cr;
       fPos = fRec * sizBK;
-      // Select the drive
-      if (selDrive(fcb.dr)) {
-        // Get the filename
-        fcb2cname(fcb, fName);
+      // Select the drive and the file
+      if (selFile()) {
         // Read one block
-        result = drv->read(ramDMA, fName, fPos);
+        result = drv->read(ramDMA, fHandle, fPos);
+        cpu->invalidate(ramDMA, sizBK);
         // Check the result
         if (!result) {
           // Increase file record and seek position with one block
@@ -531,14 +551,12 @@ uint8_t BDOS::call(uint16_t port) {
       // Get position from FCB
       fRec = (fcb.s2 & mskS2) * recS2 + fcb.ex * recEX + fcb.cr;
       fPos = fRec * sizBK;
-      // Select the drive
-      if (selDrive(fcb.dr)) {
+      // Select the drive and the file
+      if (selFile(FILE_WRITE)) {
         // Check if the drive is write protected
         if (!(rwoVector & (1 << fcb.dr))) {
-          // Get the filename on SD card
-          fcb2cname(fcb, fName);
           // Write one block
-          result = drv->write(ramDMA, fName, fPos);
+          result = drv->write(ramDMA, fHandle, fPos);
           // Check the result
           if (!result) {
             // Increase file record and seek position with one block
@@ -571,6 +589,10 @@ uint8_t BDOS::call(uint16_t port) {
           fcb2cname(fcb, fName);
           // Create the file
           if (drv->create(fName)) {
+#ifdef BDOS_FILES
+            // Keep the open file
+            oftSave();
+#endif
             // Initializes the FCB
             fcb.ex = 0x00;
             fcb.s1 = 0x00;
@@ -603,6 +625,7 @@ uint8_t BDOS::call(uint16_t port) {
           uint16_t ramNewFCB = ramFCB + 16;
           // Prevents rename from moving files among drives
           ram->setByte(ramNewFCB, ram->getByte(ramFCB));
+          cpu->invalidate(ramNewFCB, 1);
           // Create the new FCB object
           FCB_t newfcb;
           ram->read(ramNewFCB, newfcb.buf, 36);
@@ -614,6 +637,10 @@ uint8_t BDOS::call(uint16_t port) {
           // Rename the file
           if (drv->rename(fName, newName))
             result = 0x00;
+#ifdef BDOS_FILES
+          oftDrop(fName);
+          oftDrop(newName);
+#endif
         }
         else
           // Return error 4 if write protected
@@ -684,12 +711,11 @@ uint8_t BDOS::call(uint16_t port) {
       // Compute the file record and seek position
       fRec = fcb.r2 * 0x010000UL + fcb.r1 * 0x0100UL + fcb.r0;
       fPos = fRec * sizBK;
-      // Select the drive
-      if (selDrive(fcb.dr)) {
-        // Get the filename
-        fcb2cname(fcb, fName);
+      // Select the drive and the file
+      if (selFile()) {
         // Read one block
-        result = drv->read(ramDMA, fName, fPos);
+        result = drv->read(ramDMA, fHandle, fPos);
+        cpu->invalidate(ramDMA, sizBK);
         // Check the result
         if (result == 0 or result == 1 or result == 4) {
           // Adjust FCB
@@ -710,14 +736,12 @@ uint8_t BDOS::call(uint16_t port) {
       // Compute the file record and seek position
       fRec = fcb.r2 * 0x010000UL + fcb.r1 * 0x0100UL + fcb.r0;
       fPos = fRec * sizBK;
-      // Select the drive
-      if (selDrive(fcb.dr)) {
+      // Select the drive and the file
+      if (selFile(FILE_WRITE)) {
         // Check if the drive is write protected
         if (!(rwoVector & (1 << fcb.dr))) {
-          // Get the filename
-          fcb2cname(fcb, fName);
           // Write one block
-          result = drv->write(ramDMA, fName, fPos);
+          result = drv->write(ramDMA, fHandle, fPos);
           // Check the result
           if (!result) {
             // Adjust FCB
@@ -798,14 +822,12 @@ uint8_t BDOS::call(uint16_t port) {
       // Compute the file record and seek position
       fRec = fcb.r2 * 0x010000UL + fcb.r1 * 0x0100UL + fcb.r0;
       fPos = fRec * sizBK;
-      // Select the drive
-      if (selDrive(fcb.dr)) {
+      // Select the drive and the file
+      if (selFile(FILE_WRITE)) {
         // Check if the drive is write protected
         if (!(rwoVector & (1 << fcb.dr))) {
-          // Get the filename
-          fcb2cname(fcb, fName);
           // Write one block
-          result = drv->write(ramDMA, fName, fPos);
+          result = drv->write(ramDMA, fHandle, fPos);
           // Check the result
           if (!result) {
             // Adjust FCB
@@ -869,6 +891,7 @@ void BDOS::bdosError(uint8_t err) {
   // Restore the TDRIVE byte
   cDrive = tDrive;
   ram->setByte(TDRIVE, cUser << 4 | cDrive);
+  cpu->invalidate(TDRIVE, 1);
   // Always reboot on these errors.
   bios->wboot();
 }
@@ -894,6 +917,7 @@ void BDOS::readFCB() {
 void BDOS::writeFCB() {
   // Write the FCB back into RAM
   ram->write(ramFCB, fcb.buf, 36);
+  cpu->invalidate(ramFCB, 36);
 #ifdef DEBUG_FCB_WRITE
   // Show FCB
   showFCB(BDOS_CALLS[func]);
@@ -1022,6 +1046,7 @@ void BDOS::dirEntry(char *cname, uint8_t uid, uint32_t fsize) {
 #endif
   // Write the directory entry into RAM (at the DMA address)
   ram->write(ramDMA, de.buf, 32);
+  cpu->invalidate(ramDMA, 32);
 }
 
 // Autoselect the drive.
@@ -1045,6 +1070,71 @@ bool BDOS::selDrive(uint8_t drive) {
   return result;
 }
 
+// Select the drive and the file in FCB, for record I/O.
+// Keep the drive open file in fHandle, NULL if it could not be open
+bool BDOS::selFile(uint8_t mode) {
+  // Get the filename
+  fcb2cname(fcb, fName);
+#ifdef BDOS_FILES
+  // Look for the file in the open file table, no need to select the drive
+  for (OFT_t *e = oft; e < oft + BDOS_FILES; e++)
+    if (e->fh and e->addr == ramFCB and memcmp(e->cname, fName, FNZERO) == 0 and
+        drv->valid(e->fh, e->id, mode)) {
+      fHandle = e->fh;
+      return true;
+    }
+#endif
+  // Select the drive
+  if (not selDrive(fcb.dr))
+    return false;
+  // Do not open files for writing on write protected drives
+  if (mode == FILE_WRITE and (rwoVector & (1 << fcb.dr)))
+    fHandle = NULL;
+  // Check the file is open
+  else if (drv->check(fName, mode)) {
+    fHandle = drv->current();
+#ifdef BDOS_FILES
+    oftSave();
+#endif
+  }
+  else
+    fHandle = NULL;
+  return true;
+}
+
+#ifdef BDOS_FILES
+// Keep the drive open file of the FCB in the open file table,
+// replacing the entry of the same FCB, if any
+void BDOS::oftSave() {
+  OFT_t *e;
+  for (e = oft; e < oft + BDOS_FILES; e++)
+    if (e->fh and e->addr == ramFCB)
+      break;
+  if (e == oft + BDOS_FILES) {
+    // Take the next entry, round robin
+    e = oft + oftNext;
+    oftNext = (oftNext + 1) % BDOS_FILES;
+  }
+  e->addr = ramFCB;
+  memcpy(e->cname, fName, FNZERO);
+  e->fh = drv->current();
+  e->id = e->fh->id;
+}
+
+// Drop the entries of the file from the open file table
+void BDOS::oftDrop(char *cname) {
+  for (OFT_t *e = oft; e < oft + BDOS_FILES; e++)
+    if (e->fh and memcmp(e->cname, cname, FNZERO) == 0)
+      e->fh = NULL;
+}
+
+// Empty the open file table
+void BDOS::oftClear() {
+  for (OFT_t *e = oft; e < oft + BDOS_FILES; e++)
+    e->fh = NULL;
+}
+#endif
+
 // Convert FCB to CP/M file name (A0FILE    TXT)
 bool BDOS::fcb2cname(FCB_t fcb, char* fname) {
   bool unique = true;
@@ -70,6 +70,16 @@ struct DIR_t {
   };
 };
 
+#ifdef BDOS_FILES
+// Open file table entry
+struct OFT_t {
+  uint16_t  addr;               // FCB address
+  char      cname[FNZERO];      // CP/M file name (A0FILE    TXT)
+  FILE_t    *fh;                // Drive open file, NULL if free
+  uint32_t  id;                 // Drive open file id
+};
+#endif
+
 class BDOS {
   public:
     BDOS(I8080 *cpu, RAM *ram, DRIVE *drv, BIOS *bios);
@@ -92,6 +102,12 @@ class BDOS {
     void      writeFCB();
     void      showFCB(const char* comment = "");
     void      dirEntry(char *cname, uint8_t uid, uint32_t fsize);
+    bool      selFile(uint8_t mode = FILE_READ);
+#ifdef BDOS_FILES
+    void      oftSave();
+    void      oftDrop(char *cname);
+    void      oftClear();
+#endif
 
     uint8_t   func;               // BDOS function number
     uint16_t  params;             // Keep DE before BDOS call
@@ -108,6 +124,11 @@ class BDOS {
     FCB_t     fcb;                // FCB object
     char      fName[128];         // Filename
     char      cName[12];          // CP/M file name
+    FILE_t    *fHandle;           // Drive open file
+#ifdef BDOS_FILES
+    OFT_t     oft[BDOS_FILES];    // Open file table
+    uint8_t   oftNext = 0;        // Next entry to replace
+#endif
     bool      fAllUsers;          // Find files from all users
     bool      fAllExnts;          // Report all extents
     uint32_t  fSize;              // File size
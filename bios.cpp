@@ -270,8 +270,14 @@ void BIOS::boot() {
 
 // Back to CCP
 void BIOS::wboot() {
+#ifdef DEBUG_DRIVE_STATS
+  drv->stats();
+#endif
+  // Close the files left open
+  drv->closeAll();
   // Reload CCP
   drv->loadCCP();
+  cpu->invalidate(CCPCODE, BDOSCODE - CCPCODE);
   // Go to CP/M
   gocpm();
 }
@@ -280,6 +286,17 @@ void BIOS::wboot() {
 uint8_t BIOS::consts() {
   tick();
   result = Serial.available() ? 0xFF : 0x00;
+#ifdef CON_IDLE_POLLS
+  // Count the back-to-back empty polls, the guest may be waiting for input
+  uint32_t now = cpu->cycles();
+  if (result or now - idleCycles > CON_IDLE_CYCLES)
+    idlePolls = 0;
+  else if (++idlePolls >= CON_IDLE_POLLS) {
+    idlePolls = CON_IDLE_POLLS;
+    idle();
+  }
+  idleCycles = now;
+#endif
   cpu->regA(result);
   return result;
 }
@@ -298,6 +315,10 @@ void BIOS::conout() {
 }
 void BIOS::conout(uint8_t c) {
   Serial.write((char)(c & 0x7F));
+#ifdef CON_IDLE_POLLS
+  // The guest is busy, not idle
+  idlePolls = 0;
+#endif
 }
 
 // List device output character in C
@@ -396,6 +417,7 @@ void BIOS::gocpm() {
   //  Patch in a JP to the BDOS entry at location 0x0005
   ram->setByte(ENTRY, 0xC3);    // JP BDOSCODE + 0x06
   ram->setWord(ENTRY + 1, BDOSCODE + 0x06);
+  cpu->invalidate(0x0000, ENTRY + 3);
   // Last loged disk number
   cpu->regC(ram->getByte(TDRIVE));
   // Jump to CCP
@@ -411,11 +433,25 @@ void BIOS::ioByte(uint8_t iobyte) {
 }
 
 // Ticker
+#ifdef CON_IDLE_POLLS
+// Sleep until there is console input or the deadline passes
+void BIOS::idle() {
+  uint32_t start = millis();
+  while (not Serial.available() and millis() - start < CON_IDLE_SLEEP)
+    // Let the system run (and the modem sleep)
+    delay(1);
+}
+#endif
+
 void BIOS::tick() {
   if (millis() > this->nextTick) {
     // Set the next time
     nextTick += 1000;
     // LST file flush
     drv->fsLST();
+#ifdef DRV_BUFFER
+    // Write back the records kept too long
+    drv->sync(DRV_FLUSH);
+#endif
   }
 }
@@ -112,6 +112,9 @@ class BIOS {
 
     void    signon();
     void    gocpm();
+#ifdef CON_IDLE_POLLS
+    void    idle();
+#endif
 
     uint8_t result;
 
@@ -121,6 +124,10 @@ class BIOS {
     uint8_t ioLST;
 
     uint32_t nextTick;
+#ifdef CON_IDLE_POLLS
+    uint16_t idlePolls = 0;   // Consecutive empty console polls
+    uint32_t idleCycles = 0;  // CPU cycles at the last poll
+#endif
 };
 
 #endif /* BIOS_H */
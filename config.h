@@ -28,15 +28,67 @@
 //#define DEBUG_FCB_READ
 //#define DEBUG_FCB_WRITE
 //#define DEBUG_DIRENTRY
+//#define DEBUG_DRIVE_STATS
 
 // Use MCU or SPI RAM
 //#define SPI_RAM
 
+// CPU dispatch engine: threaded (computed goto) or switch
+#define CPU_THREADED
+
+// Compute the CPU flags only when they are needed
+#define CPU_LAZY_FLAGS
+
+// CPU translation cache (threaded engine only): number of blocks
+// (power of 2) and micro-ops per block (at most 85)
+#define CPU_BLOCKS      (32)
+#define CPU_BLOCK_OPS   (16)
+
+// Run the BDOS and BIOS entry stubs natively, on jumps into them
+#define CPU_FAST_TRAP
+
+// CPU cycles to run between the housekeeping tasks
+#define CPU_BUDGET  (40000)
+
+// Console idle detection: empty polls before sleeping,
+// the most CPU cycles between two polls that still count
+// as idle and the longest sleep (ms) while waiting for input.
+// A busy program checking for ^C runs more cycles between
+// polls, so it is never slowed down
+#define CON_IDLE_POLLS  (100)
+#define CON_IDLE_CYCLES (500)
+#define CON_IDLE_SLEEP  (10)
+
+// Files kept open by the drive (LRU pool)
+#define DRV_FILES       (4)
+
+// Read-ahead and write-behind buffer of each open file (bytes), a power
+// of 2, not less than the SD sector size, and the longest time (ms) the
+// written records are kept in it
+#define DRV_BUFFER      (1024)
+#define DRV_SECTOR      (512)
+#define DRV_FLUSH       (2000)
+
+// Directory index: files of the last searched drive and user directory
+// kept in RAM, larger directories are searched on SD card
+#define DRV_DIR_ENTRIES (128)
+// Hash table over the directory index, for exact name lookups, a power
+// of 2 larger than the index
+#define DRV_DIR_HASH    (256)
+
+// Open files known by BDOS (FCB address and name to drive open file)
+#define BDOS_FILES      (4)
+
 // File system block size
 #define BLS_2048
 
-// RAM cache size (bytes)
-#define RAM_BUFFER_SIZE  (8)
+// SPI RAM cache geometry: line size (bytes), ways per set (at most 8)
+// and number of sets, all powers of 2
+#define RAM_LINE_SIZE   (32)
+#define RAM_WAYS        (2)
+#define RAM_SETS        (16)
+// SPI RAM instruction fetch buffer (cache lines)
+#define RAM_FETCH_LINES (2)
 
 // Serial port speed
 #define SERIAL_SPEED  (115200)
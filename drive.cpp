@@ -110,16 +110,20 @@ bool DRIVE::loadCCP(bool verbose) {
     Serial.print(F(": "));
   }
   // Check if the file exists
+  File file;
   if (file = SD.open(fPath, FILE_READ)) {
     result = true;
     uint16_t addr = CCPCODE;
+    uint8_t *data;
     while (len > 0) {
-      // Read from file
+      // Read from file, directly into memory if possible
+      data = ram->span(addr, 128);
       ledOn();
-      len = file.read(buf, 128);
+      len = file.read(data ? data : buf, 128);
       ledOff();
       // Write into memory
-      ram->write(addr, buf, len);
+      if (not data)
+        ram->write(addr, buf, len);
       // Adjust address
       addr += len;
     }
@@ -147,6 +151,11 @@ bool DRIVE::loadCCP(bool verbose) {
   Create the user code directory
 */
 void DRIVE::mkDir(uint8_t drive, uint8_t user) {
+  // Check the known directories first
+  if (not scanned)
+    scan();
+  if (usrVector[drive & 0x0F] & (1 << (user & 0x0F)))
+    return;
   // The path according to drive letter and user code
   char disk[] = {'/', 'A' + (drive & 0x0F), '/', toHEX(user), '/', 0};
   // Build the path
@@ -154,8 +163,11 @@ void DRIVE::mkDir(uint8_t drive, uint8_t user) {
   strncat(fPath, disk, 4);
   // Check if the drive directory exists
   ledOn();
-  if (not SD.exists(fPath))
-    SD.mkdir(fPath);
+  if (SD.exists(fPath) or SD.mkdir(fPath)) {
+    // Both the drive and the user directories exist now
+    drvVector |= 1 << (drive & 0x0F);
+    usrVector[drive & 0x0F] |= 1 << (user & 0x0F);
+  }
   ledOff();
 }
 
@@ -163,81 +175,218 @@ void DRIVE::mkDir(uint8_t drive, uint8_t user) {
   Check the directory of the specified drive exists
 */
 bool DRIVE::selDrive(uint8_t drive) {
-  bool result = false;
-  // The path according to drive letter
-  char disk[] = {'/', 'A' + (drive & 0x0F), 0};
-  // Build the path
-  strncpy(fPath, bDir, 16);
-  strncat(fPath, disk, 4);
-  // Check if the drive directory exists
+  // Check the known drives
+  if (not scanned)
+    scan();
+  return drvVector & (1 << (drive & 0x0F));
+}
+
+/*
+  Find the existing drive and user directories on SD card
+*/
+void DRIVE::scan() {
+  char path[] = {'/', 'A', 0};
   ledOn();
-  if (file = SD.open(fPath, FILE_READ)) {
-    result = file.isDirectory();
-    file.close();
+  for (uint8_t drive = 0; drive < 16; drive++) {
+    usrVector[drive] = 0x0000;
+    // Build the path of the drive directory
+    path[1] = 'A' + drive;
+    strncpy(fPath, bDir, 16);
+    strncat(fPath, path, 4);
+    // Check if the drive directory exists
+    File dir = SD.open(fPath, FILE_READ);
+    if (dir and dir.isDirectory()) {
+      drvVector |= 1 << drive;
+      // Find the user directories, named by the user hex code
+      while (File file = dir.openNextFile()) {
+        const char *name = file.name();
+        if (strrchr(name, '/'))
+          name = strrchr(name, '/') + 1;
+        char c = toupper(name[0]);
+        if (file.isDirectory() and name[1] == '\0') {
+          if (c >= '0' and c <= '9')
+            usrVector[drive] |= 1 << (c - '0');
+          else if (c >= 'A' and c <= 'F')
+            usrVector[drive] |= 1 << (c - 'A' + 10);
+        }
+        file.close();
+      }
+    }
+    else
+      drvVector &= ~(1 << drive);
+    if (dir)
+      dir.close();
   }
   ledOff();
+  scanned = true;
+}
+
+/*
+  Find the drive and user directories again, on next use
+*/
+void DRIVE::rescan() {
+  scanned = false;
+#ifdef DRV_DIR_ENTRIES
+  // Drop the directory index, the card may have changed
+  dirDrive = 0;
+#endif
+}
+
+/*
+  Find the pool slot of the open file specified by the host path
+*/
+FILE_t* DRIVE::find(char *fname) {
+  for (FILE_t *fh = files; fh < files + DRV_FILES; fh++)
+    if (fh->file and strcmp(fname, fh->path) == 0)
+      return fh;
+  return NULL;
+}
+
+/*
+  Close the file in a pool slot and free the slot
+  Return false if the buffered records could not be written back
+*/
+bool DRIVE::release(FILE_t *fh) {
+  bool result = true;
+  if (fh->file) {
+#ifdef DRV_BUFFER
+    // Write back the buffered records, report any failed write back
+    flush(fh);
+    result = not fh->failed;
+    fh->failed = false;
+#endif
+    fh->file.close();
+  }
+  fh->used = 0;
   return result;
 }
 
 /*
   Check if the specified file is open in requested mode and,
-  if not, open it.  Restore the file position if needed.
+  if not, open it, in the least recently used pool slot.
+  Restore the file position if needed.
 */
 bool DRIVE::check(char* cname, uint8_t mode) {
-  bool result = false;
   char *fname;
+  FILE_t *fh;
   // Build the path
   fname = cname + FNHOST;
   cname2fname(cname, fname);
   // Check if the file is already open
-  if (file) {
-    // Check if the open file is the same
-    if (strcmp(fname, file.name()) == 0) {
-      // Check if the mode is enough
-      if (lstMode == FILE_WRITE or lstMode == mode)
-        // The file is the same
-        result = true;
-      else {
-        // The file is the same, the mode needs to be changed
-        // Keep the last position
-        uint32_t lstPos = file.position();
-        // Close the file
-        file.close();
-        // Open the file again in the specified mode
-        if (file = SD.open(fname, mode)) {
-          // Seek to the old position
-          if (file.seek(lstPos)) {
-            // Keep the mode
-            lstMode = mode;
-            result = true;
-          }
-          else
-            // Seek error, close the file
-            file.close();
-        }
+  if ((fh = find(fname)) != NULL) {
+    hits++;
+    // Check if the mode is enough
+    if (fh->mode != FILE_WRITE and fh->mode != mode) {
+      // The mode needs to be changed, keep the last position
+      uint32_t lstPos = fh->file.position();
+#ifdef DRV_BUFFER
+      // Write back the buffered records
+      flush(fh);
+#endif
+      // Close the file and open it again in the specified mode
+      fh->file.close();
+      if (fh->file = SD.open(fname, mode)) {
+        // Seek to the old position
+        if (fh->file.seek(lstPos))
+          // Keep the mode
+          fh->mode = mode;
+        else
+          // Seek error, close the file
+          fh->file.close();
       }
-    }
-    else {
-      // The file is not the same
-      // Close the old file
-      file.close();
-      // Open the new file in the specified mode
-      if (file = SD.open(fname, mode)) {
-        // Keep the last open mode
-        lstMode = mode;
-        result = true;
+      if (not fh->file) {
+        release(fh);
+        return false;
       }
     }
   }
   else {
-    // The file is not open, open it
-    if (file = SD.open(fname, mode)) {
-      // Keep the last mode
-      lstMode = mode;
-      result = true;
+    misses++;
+#ifdef DRV_DIR_HASH
+    // Look the file up in the directory index, a file missing from
+    // an indexed directory can not be open for reading
+    if (mode != FILE_WRITE) {
+      if (not dirCovers(cname))
+        dirSkips++;
+      else if (dirFind(cname))
+        dirHits++;
+      else {
+        dirMisses++;
+        return false;
+      }
     }
+#endif
+    // Take the least recently used slot, free ones first
+    fh = files;
+    for (FILE_t *f = files + 1; f < files + DRV_FILES; f++)
+      if (f->used < fh->used)
+        fh = f;
+#ifdef DRV_BUFFER
+    // Remember the file if its records are lost, the error
+    // is reported when it is written or closed again
+    if (not release(fh))
+      strcpy(lost, fh->path);
+#else
+    release(fh);
+#endif
+    // Open the new file in the specified mode
+    if (not (fh->file = SD.open(fname, mode)))
+      return false;
+    // Keep the path and the open mode
+    strncpy(fh->path, fname, sizeof(fh->path) - 1);
+    fh->path[sizeof(fh->path) - 1] = '\0';
+    fh->mode = mode;
+    // New open file id
+    fh->id = useCount + 1;
+#ifdef DRV_DIR_ENTRIES
+    // The file may be new
+    if (mode == FILE_WRITE)
+      dirUpdate(cname, fh->file.size());
+#endif
+#ifdef DRV_BUFFER
+    // Empty read-ahead buffer
+    fh->bufLen = 0;
+    fh->depth = DRV_SECTOR;
+    fh->dirty = false;
+    fh->failed = strcmp(fname, lost) == 0;
+    if (fh->failed)
+      lost[0] = '\0';
+#endif
   }
-  return result;
+  // Most recently used, and the current one
+  fh->used = ++useCount;
+  file = fh;
+  return true;
+}
+
+/*
+  Return the pool slot of the file last checked
+*/
+FILE_t* DRIVE::current() {
+  return file;
+}
+
+/*
+  Check the pool slot still holds the same open file, in a mode
+  good enough for the requested one
+*/
+bool DRIVE::valid(FILE_t *fh, uint32_t id, uint8_t mode) {
+  return fh->file and fh->id == id and
+         (fh->mode == FILE_WRITE or fh->mode == mode);
+}
+
+/*
+  Close all the open files
+*/
+void DRIVE::closeAll() {
+  for (FILE_t *fh = files; fh < files + DRV_FILES; fh++)
+#ifdef DRV_BUFFER
+    // Remember the file if its records are lost, as on eviction
+    if (not release(fh))
+      strcpy(lost, fh->path);
+#else
+    release(fh);
+#endif
 }
 
 /*
@@ -256,15 +405,42 @@ bool DRIVE::open(char* cname, uint8_t mode) {
 
 /*
   Close the file specified by the host file name
+  Return false if its buffered records could not be written back
 */
-void DRIVE::close(char* cname) {
+bool DRIVE::close(char* cname) {
+  bool result = true;
+  FILE_t *fh;
+  // Build the path
+  char *fname = cname + FNHOST;
+  cname2fname(cname, fname);
   ledOn();
-  // Check the file is open
-  if (file)
-    if (check(cname))
-      // Close it
-      file.close();
+  // Check the file is open and close it
+  if ((fh = find(fname)) != NULL)
+    result = release(fh);
+#ifdef DRV_BUFFER
+  // The file may have been closed already, after a failed write back
+  else if (strcmp(fname, lost) == 0) {
+    lost[0] = '\0';
+    result = false;
+  }
+#endif
   ledOff();
+  return result;
+}
+
+/*
+  Print the open files pool statistics
+*/
+void DRIVE::stats() {
+  char buf[96] = "";
+  sprintf_P(buf, PSTR("eCPM: Open files pool: %lu hits, %lu misses\r\n"),
+            (unsigned long)hits, (unsigned long)misses);
+  Serial.print(buf);
+#ifdef DRV_DIR_HASH
+  sprintf_P(buf, PSTR("eCPM: Directory index: %lu found, %lu missing, %lu not indexed\r\n"),
+            (unsigned long)dirHits, (unsigned long)dirMisses, (unsigned long)dirSkips);
+  Serial.print(buf);
+#endif
 }
 
 /*
@@ -275,9 +451,14 @@ uint32_t DRIVE::fileSize(char* cname, uint8_t mode) {
   // Open the file and get the size
   ledOn();
   // Check the file is open
-  if (check(cname, mode))
+  if (check(cname, mode)) {
+#ifdef DRV_BUFFER
+    // Write back the buffered records
+    flush(file);
+#endif
     // Get the size
-    len = file.size();
+    len = file->file.size();
+  }
   ledOff();
   return len;
 }
@@ -310,9 +491,21 @@ uint8_t DRIVE::findFirst(char* cname, uint32_t &fsize) {
   // Keep the path in fPath
   strncpy(fPath, bDir, 16);
   strncat(fPath, path, 6);
+#ifdef DRV_BUFFER
+  // Write back all the buffered records, for the right file sizes
+  sync(0);
+#endif
   // Close any previously opened SD directory
   if (fDir)
     fDir.close();
+#ifdef DRV_DIR_ENTRIES
+  // Search the directory index, if the directory fits in
+  if (dirIndex(fDrive, fUser)) {
+    dirNext = 0;
+    return findNext(cname, fsize);
+  }
+  dirNext = -1;
+#endif
   // Open the SD directory (aka drive in CP/M)
   if (fDir = SD.open(fPath))
     // Check if the directory exists
@@ -333,6 +526,33 @@ uint8_t DRIVE::findFirst(char* cname, uint32_t &fsize) {
 */
 uint8_t DRIVE::findNext(char *cname, uint32_t &fsize) {
   uint8_t result = 0xFF;
+#ifdef DRV_DIR_ENTRIES
+  // Search the directory index
+  if (dirNext >= 0) {
+    // Check the index is still there.  If it overflowed meanwhile,
+    // the files it holds are still up to date, only the new ones
+    // are missing, so keep listing them
+    if (dirDrive != toupper(fDrive) or dirUser != toupper(fUser))
+      return result;
+    while (dirNext < dirCount) {
+      DIRENT_t *de = &dirs[dirNext++];
+      // Match the pattern
+      if (match(de->name, fPattern)) {
+        // Build the CP/M name and the host file name
+        cname[FNDRIVE] = fDrive;
+        cname[FNUSER]  = fUser;
+        memcpy(cname + FNFILE, de->name, 11);
+        cname[FNZERO]  = '\0';
+        cname2fname(cname, cname + FNHOST);
+        fsize = de->size;
+        // Success
+        result = 0x00;
+        break;
+      }
+    }
+    return result;
+  }
+#endif
   ledOn();
   // Find the next file, skipping over directories
   while (File file = fDir.openNextFile()) {
@@ -359,6 +579,174 @@ uint8_t DRIVE::findNext(char *cname, uint32_t &fsize) {
   return result;
 }
 
+#ifdef DRV_DIR_ENTRIES
+/*
+  Make sure the directory index holds the specified drive and user
+  directory, whose path is in fPath, reading it from SD card if needed.
+  Return false if the directory does not fit in.
+*/
+bool DRIVE::dirIndex(char drive, char user) {
+  char cname[128];
+  // Check the current index, read it again if it overflowed
+  // and some files were removed since
+  if (dirDrive == toupper(drive) and dirUser == toupper(user) and
+      not (dirOver and dirCount < DRV_DIR_ENTRIES))
+    return not dirOver;
+  // Read the directory
+  dirDrive = 0;
+  dirCount = 0;
+  File dir = SD.open(fPath);
+  if (not dir)
+    return false;
+  dirDrive = toupper(drive);
+  dirUser  = toupper(user);
+  dirOver  = false;
+  ledOn();
+  while (File file = dir.openNextFile()) {
+    // Skip over host directories
+    if (not file.isDirectory()) {
+      // Check there is room for it, remember it does not fit
+      if (dirCount == DRV_DIR_ENTRIES) {
+        dirOver = true;
+        file.close();
+        break;
+      }
+      // Convert the file name to CP/M name
+      strcpy(cname + FNHOST, dir.name());
+      strcat(cname + FNHOST, file.name());
+      fname2cname(cname + FNHOST, cname);
+      memcpy(dirs[dirCount].name, cname + FNFILE, 11);
+      dirs[dirCount].size = file.size();
+      dirCount++;
+    }
+    file.close();
+  }
+  dir.close();
+  ledOff();
+#ifdef DRV_DIR_HASH
+  dirRehash();
+#endif
+  return not dirOver;
+}
+
+/*
+  Check the directory of the CP/M name (A0FILE    TXT) is indexed,
+  some files may be missing if the index overflowed
+*/
+bool DRIVE::dirHolds(char *cname) {
+  return dirDrive == toupper(cname[FNDRIVE]) and dirUser == toupper(cname[FNUSER]);
+}
+
+/*
+  Check the directory of the CP/M name (A0FILE    TXT) is fully indexed
+*/
+bool DRIVE::dirCovers(char *cname) {
+  return dirHolds(cname) and not dirOver;
+}
+
+/*
+  Find a file in the directory index, by CP/M name (A0FILE    TXT)
+*/
+DIRENT_t* DRIVE::dirFind(char *cname) {
+  if (dirHolds(cname)) {
+#ifdef DRV_DIR_HASH
+    // Probe the hash table, until an empty slot
+    uint16_t h = dirHashOf(cname + FNFILE);
+    for (uint8_t k; (k = dirHash[h]) != 0; h = (h + 1) & (DRV_DIR_HASH - 1))
+      if (memcmp(dirs[k - 1].name, cname + FNFILE, 11) == 0)
+        return &dirs[k - 1];
+#else
+    for (DIRENT_t *de = dirs; de < dirs + dirCount; de++)
+      if (memcmp(de->name, cname + FNFILE, 11) == 0)
+        return de;
+#endif
+  }
+  return NULL;
+}
+
+#ifdef DRV_DIR_HASH
+/*
+  Hash a CP/M file name (FILE    TXT)
+*/
+uint16_t DRIVE::dirHashOf(char *name) {
+  uint32_t h = 2166136261UL;
+  for (uint8_t i = 0; i < 11; i++)
+    h = (h ^ (uint8_t)name[i]) * 16777619UL;
+  return (h ^ (h >> 16)) & (DRV_DIR_HASH - 1);
+}
+
+/*
+  Add a directory index entry to the hash table
+*/
+void DRIVE::dirInsert(uint16_t idx) {
+  uint16_t h = dirHashOf(dirs[idx].name);
+  while (dirHash[h])
+    h = (h + 1) & (DRV_DIR_HASH - 1);
+  dirHash[h] = idx + 1;
+}
+
+/*
+  Build the hash table of the directory index
+*/
+void DRIVE::dirRehash() {
+  memset(dirHash, 0, sizeof(dirHash));
+  for (uint16_t idx = 0; idx < dirCount; idx++)
+    dirInsert(idx);
+}
+#endif
+
+/*
+  Add a file to the directory index, or update its size
+*/
+void DRIVE::dirUpdate(char *cname, uint32_t size) {
+  DIRENT_t *de;
+  // Check the directory is indexed, keep the files in it
+  // up to date even after an overflow
+  if (not dirHolds(cname))
+    return;
+  if (not (de = dirFind(cname))) {
+    // Check there is room for it
+    if (dirCount == DRV_DIR_ENTRIES) {
+      dirOver = true;
+      return;
+    }
+    de = &dirs[dirCount++];
+    memcpy(de->name, cname + FNFILE, 11);
+#ifdef DRV_DIR_HASH
+    dirInsert(dirCount - 1);
+#endif
+  }
+  de->size = size;
+}
+
+/*
+  Update the size of an open file in the directory index
+*/
+void DRIVE::dirUpdate(FILE_t *fh) {
+  char cname[FNZERO + 1];
+  fname2cname(fh->path, cname);
+  dirUpdate(cname, fh->file.size());
+}
+
+/*
+  Remove a file from the directory index, keeping the order
+*/
+void DRIVE::dirRemove(char *cname) {
+  DIRENT_t *de;
+  if ((de = dirFind(cname)) != NULL) {
+    uint16_t idx = de - dirs;
+    memmove(de, de + 1, (dirCount - idx - 1) * sizeof(DIRENT_t));
+    dirCount--;
+#ifdef DRV_DIR_HASH
+    dirRehash();
+#endif
+    // Keep the search going
+    if (dirNext > idx)
+      dirNext--;
+  }
+}
+#endif
+
 // Check if there is a "$$$.SUB" file on the A drive
 uint8_t DRIVE::checkSUB(uint8_t drive, uint8_t user) {
   char fName[128] = "A0$$$     SUB";
@@ -369,28 +757,50 @@ uint8_t DRIVE::checkSUB(uint8_t drive, uint8_t user) {
   return result;
 }
 
-uint8_t DRIVE::read(uint16_t ramDMA, char* cname, uint32_t fpos) {
+/*
+  Read one block from the open file, NULL if the file could not be open
+*/
+uint8_t DRIVE::read(uint16_t ramDMA, FILE_t *fh, uint32_t fpos) {
   uint8_t result = 0xFF;
   uint8_t buf[sizBK];
+  // Use the DMA buffer directly, if possible, or bounce it
+  uint8_t *data = ram->span(ramDMA, sizBK);
   ledOn();
   // Check the file is open
-  if (check(cname)) {
+  if (fh) {
+    // Most recently used
+    fh->used = ++useCount;
     // Seek success flag
     bool skok = false;
+    // Bytes read
+    int len = 0;
+    if (not data)
+      data = buf;
+#ifdef DRV_BUFFER
+    // Read through the read-ahead buffer
+    skok = rdBuffer(fh, fpos, data, len);
+#else
     // Check if we need to seek
-    if (file.position() == fpos)
+    if (fh->file.position() == fpos)
       // No need to seek, already on position
       skok = true;
     else
       // Seek
-      skok = file.seek(fpos);
+      skok = fh->file.seek(fpos);
     if (skok) {
-      // Clear the buffer (^Z)
-      memset(buf, 0x1A, sizBK);
       // Read from file
-      if (file.read(&buf[0], sizBK)) {
+      len = fh->file.read(data, sizBK);
+      // Pad a short block (^Z), leave the DMA alone if nothing was read
+      if (len > 0 and len < sizBK)
+        memset(data + len, 0x1A, sizBK - len);
+    }
+#endif
+    if (skok) {
+      // Check the read
+      if (len) {
         // Write into RAM
-        ram->write(ramDMA, buf, sizBK);
+        if (data == buf)
+          ram->write(ramDMA, buf, sizBK);
         result = 0x00;
       }
       else
@@ -402,7 +812,7 @@ uint8_t DRIVE::read(uint16_t ramDMA, char* cname, uint32_t fpos) {
         // Seek past 8MB (largest file size in CP/M)
         result = 0x06;
       else {
-        uint32_t exSize = file.size();
+        uint32_t exSize = fh->file.size();
         // Round the file size up to next full logical extent
         exSize = sizEX * ((exSize / sizEX) + ((exSize % sizEX) ? 1 : 0));
         if (fpos < exSize)
@@ -420,30 +830,184 @@ uint8_t DRIVE::read(uint16_t ramDMA, char* cname, uint32_t fpos) {
   return result;
 }
 
-uint8_t DRIVE::write(uint16_t ramDMA, char* cname, uint32_t fpos) {
+#ifdef DRV_BUFFER
+/*
+  Read one block through the read-ahead buffer of the open file.
+  On a miss, the buffer is filled starting with the sector holding
+  the block; sequential reads double the read-ahead size, up to the
+  buffer size, random ones reset it to one sector.
+  Return false on seek error, the number of bytes read in len.
+*/
+bool DRIVE::rdBuffer(FILE_t *fh, uint32_t fpos, uint8_t *data, int &len) {
+  // Check if the block is in the buffer
+  if (fpos < fh->bufPos or fpos >= fh->bufPos + fh->bufLen) {
+    // Write back the buffered records
+    flush(fh);
+    // Can not seek past the end of file
+    if (fpos > fh->file.size())
+      return false;
+    // Adapt the read-ahead size
+    if (fh->bufLen and fpos == fh->bufPos + fh->bufLen) {
+      if (fh->depth < DRV_BUFFER)
+        fh->depth <<= 1;
+    }
+    else
+      fh->depth = DRV_SECTOR;
+    // Fill the buffer, starting at the sector boundary
+    uint32_t start = fpos & ~(uint32_t)(DRV_SECTOR - 1);
+    if (fh->bufLen and fpos == fh->bufPos + fh->bufLen)
+      start = fpos;
+    fh->bufLen = 0;
+    if (fh->file.position() != start and not fh->file.seek(start))
+      return false;
+    int n = fh->file.read(fh->buf, fh->depth);
+    fh->bufPos = start;
+    fh->bufLen = n > 0 ? n : 0;
+  }
+  // Copy the block, it may be short at the end of file
+  len = 0;
+  if (fpos < fh->bufPos + fh->bufLen) {
+    len = fh->bufPos + fh->bufLen - fpos;
+    if (len > sizBK)
+      len = sizBK;
+    memcpy(data, fh->buf + (fpos - fh->bufPos), len);
+    // Pad a short block (^Z), leave the DMA alone if nothing was read
+    if (len < sizBK)
+      memset(data + len, 0x1A, sizBK - len);
+  }
+  return true;
+}
+
+/*
+  Keep one block in the write-behind buffer of the open file, if it
+  extends or overwrites the buffered data.  Otherwise, write back the
+  buffer and start a new one with this block, unless it would leave
+  a hole in the file.
+  Return false if the block has to be written directly.
+*/
+bool DRIVE::wrBuffer(FILE_t *fh, uint32_t fpos, uint8_t *data) {
+  // Check if the block fits in the buffer, without holes
+  if (fh->bufLen == 0 or fpos < fh->bufPos or fpos > fh->bufPos + fh->bufLen or
+      fpos + sizBK > fh->bufPos + DRV_BUFFER) {
+    // Write back the buffered records
+    if (not flush(fh))
+      return false;
+    fh->bufLen = 0;
+    // Do not start past the end of file
+    if (fpos > fh->file.size())
+      return false;
+    fh->bufPos = fpos;
+  }
+  // Copy the block
+  memcpy(fh->buf + (fpos - fh->bufPos), data, sizBK);
+  if (fpos + sizBK > fh->bufPos + fh->bufLen)
+    fh->bufLen = fpos + sizBK - fh->bufPos;
+  // Keep the time of the first unsaved write
+  if (not fh->dirty) {
+    fh->dirty = true;
+    fh->dirtyTime = millis();
+  }
+  return true;
+}
+
+/*
+  Write back the buffered records of the open file, if any
+  Return false on write error, which is also kept in the file
+  slot until reported by the next write or close
+*/
+bool DRIVE::flush(FILE_t *fh) {
+  bool result = true;
+  if (fh->dirty) {
+    fh->dirty = false;
+    ledOn();
+    if ((fh->file.position() != fh->bufPos and not fh->file.seek(fh->bufPos)) or
+        fh->file.write(fh->buf, fh->bufLen) != fh->bufLen) {
+      // Write error, the buffer is lost, report it later
+      fh->bufLen = 0;
+      fh->failed = true;
+      result = false;
+    }
+#ifdef DRV_DIR_ENTRIES
+    dirUpdate(fh);
+#endif
+    ledOff();
+  }
+  return result;
+}
+
+/*
+  Write back the records buffered for more than the specified time (ms)
+*/
+void DRIVE::sync(uint32_t age) {
+  for (FILE_t *fh = files; fh < files + DRV_FILES; fh++)
+    if (fh->file and fh->dirty and millis() - fh->dirtyTime >= age) {
+      flush(fh);
+      fh->file.flush();
+    }
+}
+#endif
+
+/*
+  Write one block into the file open in write mode, NULL if the file
+  could not be open
+*/
+uint8_t DRIVE::write(uint16_t ramDMA, FILE_t *fh, uint32_t fpos) {
   uint8_t result = 0xFF;
   uint8_t buf[sizBK];
+  // Use the DMA buffer directly, if possible, or bounce it
+  uint8_t *data = ram->span(ramDMA, sizBK);
   ledOn();
-  // Check the file is open in write mode
-  if (check(cname, FILE_WRITE)) {
+  // Check the file is open
+  if (fh) {
+    // Most recently used
+    fh->used = ++useCount;
+    // Read from RAM after flushing the buffers
+    if (not data) {
+      ram->read(ramDMA, buf, sizBK);
+      data = buf;
+    }
+#ifdef DRV_BUFFER
+    // Keep the block in the write-behind buffer, if possible
+    if (not fh->failed and wrBuffer(fh, fpos, data)) {
+      ledOff();
+      return 0x00;
+    }
+    // Report a failed write back of the buffered records, done
+    // earlier in background or now to make room for this block
+    if (fh->failed) {
+      fh->failed = false;
+      ledOff();
+      return 0x02;
+    }
+#endif
     // Seek success flag
     bool skok = false;
     // Check if we need to seek
-    if (file.position() == fpos)
+    if (fh->file.position() == fpos)
       // No need to seek, already on position
       skok = true;
     else {
       // Check if we need to seek beyond its end
-      if (fpos > file.size()) {
+      if (fpos > fh->file.size()) {
         // Yes, seek to end
-        if (file.seek(file.size())) {
-          // Append
-          for (uint32_t i = 0; i < fpos - file.size(); i++)
-            if (file.write((uint8_t)0x1A) != 1) {
+        if (fh->file.seek(fh->file.size())) {
+          // Append, filling the gap with ^Z, one block at a time
+          uint8_t fill[sizBK];
+          memset(fill, 0x1A, sizBK);
+          uint32_t gap = fpos - fh->file.size();
+          uint16_t len;
+          skok = true;
+          while (gap) {
+            len = gap > sizBK ? sizBK : gap;
+            if (fh->file.write(fill, len) != len) {
               // Disk full
               result = 0x02;
+              skok = false;
               break;
             }
+            gap -= len;
+            yield();
+          }
         }
         else
           // Seek error
@@ -451,20 +1015,21 @@ uint8_t DRIVE::write(uint16_t ramDMA, char* cname, uint32_t fpos) {
       }
       else {
         // Seek inside written file
-        skok = file.seek(fpos);
+        skok = fh->file.seek(fpos);
       }
     }
     // Check if the file seek was successfull
     if (skok) {
-      // Read from RAM after flushing the buffers
-      ram->read(ramDMA, buf, sizBK);
       // Write to file
-      if (file.write(&buf[0], sizBK))
+      if (fh->file.write(data, sizBK))
         result = 0x00;
       else
         // Write error
         result = 0x02;
     }
+#ifdef DRV_DIR_ENTRIES
+    dirUpdate(fh);
+#endif
   }
   else
     // Open error
@@ -490,8 +1055,13 @@ bool DRIVE::remove(char* cname) {
   fname = cname + FNHOST;
   cname2fname(cname, fname);
   ledOn();
+  // Close it first, if open
+  close(cname);
   if (SD.exists(fname))
     SD.remove(fname);
+#ifdef DRV_DIR_ENTRIES
+  dirRemove(cname);
+#endif
   ledOff();
   return true;
 }
@@ -514,25 +1084,47 @@ bool DRIVE::rename(char* cname, char* newname) {
   cname2fname(cname, fname);
   nfname = newname + FNHOST;
   cname2fname(newname, nfname);
-  // The two file handlers
-  File frFile, toFile;
+  // Close the files, if open
+  close(cname);
+  close(newname);
   ledOn();
   if (SD.exists(fname)) {
-    if (frFile = SD.open(fname, FILE_READ)) {
-      if (toFile = SD.open(nfname, FILE_WRITE)) {
-        uint8_t len;
-        uint8_t buf[128];
-        while ((len = frFile.read(buf, sizeof(buf))) > 0) {
-          toFile.write(buf, len);
+#ifdef ESP8266
+    // Rename it in place, only the directory entry changes
+    result = SD.rename(fname, nfname);
+#endif
+    // Copy the file, if the file system could not rename it
+    if (not result) {
+      // The two file handlers
+      File frFile, toFile;
+      if (frFile = SD.open(fname, FILE_READ)) {
+        if (toFile = SD.open(nfname, FILE_WRITE)) {
+          int len;
+          uint8_t buf[128];
+          result = true;
+          while ((len = frFile.read(buf, sizeof(buf))) > 0)
+            if (toFile.write(buf, len) != (size_t)len) {
+              // Write error
+              result = false;
+              break;
+            }
+          toFile.close();
         }
-        toFile.close();
+        frFile.close();
       }
-      frFile.close();
+      // Remove the old file, or the incomplete copy
+      if (result)
+        SD.remove(fname);
+      else if (SD.exists(nfname))
+        SD.remove(nfname);
     }
-    // Remove the old file
-    if (SD.exists(nfname) and SD.exists(fname))
-      SD.remove(fname);
-    //SD.rename(fname, nfname);
+#ifdef DRV_DIR_ENTRIES
+    if (result) {
+      DIRENT_t *de = dirFind(cname);
+      dirUpdate(newname, de ? de->size : 0);
+      dirRemove(cname);
+    }
+#endif
   }
   ledOff();
   return result;
@@ -542,9 +1134,18 @@ bool DRIVE::truncate(char* cname, uint8_t rec) {
   bool result = false;
   ledOn();
   // Check the file is open in write mode
-  if (check(cname, FILE_WRITE))
-    if (file.truncate(rec * sizBK))
+  if (check(cname, FILE_WRITE)) {
+#ifdef DRV_BUFFER
+    // Write back the buffered records and drop the data
+    flush(file);
+    file->bufLen = 0;
+#endif
+    if (file->file.truncate(rec * sizBK))
       result = true;
+#ifdef DRV_DIR_ENTRIES
+    dirUpdate(file);
+#endif
+  }
   ledOff();
   return result;
 }
@@ -587,6 +1188,9 @@ bool DRIVE::ckLST() {
       // Set the timestamp
       tsLST = millis();
       result = true;
+#ifdef DRV_DIR_ENTRIES
+      dirUpdate(cname, devLST.size());
+#endif
     }
     ledOff();
   }
@@ -617,6 +1221,11 @@ void DRIVE::clLST() {
     // Check if the timestamp has been set
     if (tsLST > 0) {
       ledOn();
+#ifdef DRV_DIR_ENTRIES
+      // Keep the size in the directory index
+      char cname[] = "A0DEV-LST TXT";
+      dirUpdate(cname, devLST.size());
+#endif
       // Close the file
       devLST.close();
       ledOff();
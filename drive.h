@@ -33,6 +33,38 @@ typedef MCURAM RAM;
 #endif
 
 
+// Open file in the pool
+struct FILE_t {
+  File      file;
+  char      path[48];           // Host path
+  uint8_t   mode;               // Open mode
+  uint32_t  used;               // Last use, 0 if free
+  uint32_t  id;                 // Open file id
+#ifdef DRV_BUFFER
+  uint8_t   buf[DRV_BUFFER];    // Read-ahead and write-behind buffer
+  uint32_t  bufPos;             // File position of the buffer
+  uint16_t  bufLen;             // Bytes in buffer, 0 if empty
+  uint16_t  depth;              // Read-ahead size
+  bool      dirty;              // The buffer holds unsaved records
+  uint32_t  dirtyTime;          // Time of the first unsaved record
+  bool      failed;             // A write back failed, not reported yet
+#endif
+};
+
+#ifdef DRV_DIR_HASH
+#if DRV_DIR_ENTRIES > 254 or DRV_DIR_HASH <= DRV_DIR_ENTRIES
+#error "The directory hash (DRV_DIR_HASH) must be larger than the index (DRV_DIR_ENTRIES), at most 254 entries"
+#endif
+#endif
+
+#ifdef DRV_DIR_ENTRIES
+// Directory index entry
+struct DIRENT_t {
+  char      name[11];           // CP/M name (FILE    TXT)
+  uint32_t  size;               // File size
+};
+#endif
+
 class DRIVE {
   public:
     DRIVE(RAM *ram, char *bdir = "");
@@ -41,19 +73,27 @@ class DRIVE {
     bool      loadCCP(bool verbose = false);
     void      mkDir(uint8_t drive, uint8_t user);
     bool      selDrive(uint8_t drive);
+    void      rescan();
     uint32_t  fileSize(char* fname, uint8_t mode = FILE_READ);
     uint8_t   findFirst(char* fname, uint32_t &fsize);
     uint8_t   findNext(char* fname, uint32_t &fsize);
     uint8_t   checkSUB(uint8_t drive, uint8_t user);
-    uint8_t   read(uint16_t ramDMA, char* fname, uint32_t fpos);
-    uint8_t   write(uint16_t ramDMA, char* fname, uint32_t fpos);
+    uint8_t   read(uint16_t ramDMA, FILE_t *fh, uint32_t fpos);
+    uint8_t   write(uint16_t ramDMA, FILE_t *fh, uint32_t fpos);
     bool      check(char* fname, uint8_t mode = FILE_READ);
+    FILE_t*   current();
+    bool      valid(FILE_t *fh, uint32_t id, uint8_t mode = FILE_READ);
+    void      closeAll();
+#ifdef DRV_BUFFER
+    void      sync(uint32_t age = 0);
+#endif
     bool      open(char* fname, uint8_t mode = FILE_READ);
-    void      close(char* fname);
+    bool      close(char* fname);
     bool      create(char* fname);
     bool      remove(char* fname);
     bool      rename(char* fname, char* newname);
     bool      truncate(char* fname, uint8_t rec);
+    void      stats();
 
     bool      ckLST();
     void      wrLST(char c);
@@ -69,6 +109,28 @@ class DRIVE {
     uint8_t   fname2cname(char *fname, char *cname);
     void      cname2fname(char *cname, char *fname);
     bool      match(char *cname, char* pattern);
+    void      scan();
+#ifdef DRV_BUFFER
+    bool      rdBuffer(FILE_t *fh, uint32_t fpos, uint8_t *data, int &len);
+    bool      wrBuffer(FILE_t *fh, uint32_t fpos, uint8_t *data);
+    bool      flush(FILE_t *fh);
+#endif
+#ifdef DRV_DIR_ENTRIES
+    bool      dirIndex(char drive, char user);
+    bool      dirHolds(char *cname);
+    bool      dirCovers(char *cname);
+    DIRENT_t* dirFind(char *cname);
+    void      dirUpdate(char *cname, uint32_t size);
+    void      dirUpdate(FILE_t *fh);
+    void      dirRemove(char *cname);
+#endif
+#ifdef DRV_DIR_HASH
+    uint16_t  dirHashOf(char *name);
+    void      dirInsert(uint16_t idx);
+    void      dirRehash();
+#endif
+    FILE_t*   find(char *fname);
+    bool      release(FILE_t *fh);
 
     char      *bDir;              // Base directory on SD card
     char      fPath[64];          // Base file path
@@ -76,9 +138,32 @@ class DRIVE {
     char      fUser;              // The user hex code of the file to find
     char      fPattern[12];       // File name pattern for searching
 
-    File      file;               // Current file in use
+    FILE_t    files[DRV_FILES];   // Open files pool
+    FILE_t    *file;              // Current file in use
+    uint32_t  useCount = 0;       // Pool use counter
+    uint32_t  hits = 0;           // Pool hits
+    uint32_t  misses = 0;         // Pool misses
     File      fDir;               // The directory to look into
-    uint8_t   lstMode;            // Last file open mode
+    bool      scanned = false;    // The drive and user vectors are valid
+    uint16_t  drvVector = 0x0000; // Existing drive directories
+    uint16_t  usrVector[16];      // Existing user directories, per drive
+#ifdef DRV_BUFFER
+    char      lost[48] = "";      // Path of a file evicted after a failed write back
+#endif
+#ifdef DRV_DIR_ENTRIES
+    DIRENT_t  dirs[DRV_DIR_ENTRIES];  // Directory index
+    uint16_t  dirCount = 0;       // Files in the directory index
+    char      dirDrive = 0;       // Indexed drive letter, 0 if none
+    char      dirUser;            // Indexed user hex code
+    bool      dirOver;            // The directory does not fit in
+    int16_t   dirNext = -1;       // Next index entry to search, -1 on SD
+#endif
+#ifdef DRV_DIR_HASH
+    uint8_t   dirHash[DRV_DIR_HASH];  // Directory index entries + 1, by name
+    uint32_t  dirHits = 0;        // Opens found in the index
+    uint32_t  dirMisses = 0;      // Opens missing from the index
+    uint32_t  dirSkips = 0;       // Opens in directories not indexed
+#endif
 
     File      devLST;             // The LIST device as file
     uint32_t  tsLST;              // The LIST device timestamp
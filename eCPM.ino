@@ -40,26 +40,12 @@ void    callBIOS(int port, int value);
 
 #ifdef SPI_RAM
 // SPI RAM
-SPIRAM ram(RS, RAM_BUFFER_SIZE);
+SPIRAM ram(RS);
 #else
 // MCU RAM
 MCURAM ram;
 #endif
 
-int  I8080::read_word(int addr) {
-  return ram.getWord(addr);
-}
-void I8080::write_word(int addr, int word) {
-  return ram.setWord(addr, word);
-}
-
-int  I8080::read_byte(int addr) {
-  return ram.getByte(addr);
-}
-void I8080::write_byte(int addr, int byte) {
-  ram.setByte(addr, byte);
-}
-
 int  I8080::io_input(int port) {
   return callBDOS(port);
 }
@@ -72,7 +58,7 @@ void I8080::iff(int on) {
 }
 
 
-I8080 cpu;
+I8080 cpu(&ram);
 DRIVE drv(&ram, "eCPM");
 BIOS bios(&cpu, &ram, &drv);
 BDOS bdos(&cpu, &ram, &drv, &bios);
@@ -110,6 +96,8 @@ void setup() {
   // Init additional RAM if possible
   ram.init();
 #endif
+  // Init the CPU
+  cpu.init();
   // Init the BIOS
   bios.init();
   // Init the BDOS
@@ -126,9 +114,9 @@ void setup() {
   Main Arduino loop
 */
 void loop() {
-  // Check the CPU state and run
+  // Check the CPU state and run a batch of instructions
   if (cpu.state) {
-    cpu.instruction();
+    cpu.run(CPU_BUDGET);
     //cpu.trace();
   }
 
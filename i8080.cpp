@@ -35,14 +35,58 @@
 
 #include "i8080.h"
 
-#define RD_BYTE(addr) read_byte(addr)
-#define RD_WORD(addr) read_word(addr)
+#define RD_BYTE(addr) ram->getByte(addr)
+#define RD_WORD(addr) ram->getWord(addr)
+// Instruction stream reads, through the fetch path of the memory
+#define RD_CODE(addr) ram->fetch(addr)
+#define RD_CODE16(addr) (RD_CODE(addr) | RD_CODE((uns16)((addr) + 1)) << 8)
+
+#ifdef CPU_BLOCKS
+// Writes into translated code invalidate the affected blocks
+#define WR_BYTE(addr, value) {                   \
+    waddr = (addr);                              \
+    ram->setByte(waddr, value);                  \
+    if (IS_CODE(waddr)) {                        \
+      invalidate(waddr, 1);                      \
+      uend = uop;                                \
+    }                                            \
+  }
+#define WR_WORD(addr, value) {                   \
+    waddr = (addr);                              \
+    ram->setWord(waddr, value);                  \
+    if (IS_CODE(waddr) or                        \
+        IS_CODE((uns16)(waddr + 1))) {           \
+      invalidate(waddr, 2);                      \
+      uend = uop;                                \
+    }                                            \
+  }
+
+// The immediate operands are already decoded in the micro-op
+#define IMM8()          (PC++, (uns8)uop->w)
+#define IMM16()         (uop->w)
+
+// Code map, one bit for each 32 bytes line holding translated code
+#define IS_CODE(addr)   (codeMap[(addr) >> 8] & (1 << (((addr) >> 5) & 0x07)))
+#define SET_CODE(addr)  (codeMap[(addr) >> 8] |= (1 << (((addr) >> 5) & 0x07)))
+#define CLR_CODE(addr)  (codeMap[(addr) >> 8] &= ~(1 << (((addr) >> 5) & 0x07)))
+
+// Check if the block overlaps the memory range
+#define OVERLAP(blk, addr, len)                  \
+    ((uns16)((addr) - (blk)->pc) < (blk)->size or \
+     (uns16)((blk)->pc - (addr)) < (len))
+
+// Opcode information: instruction length and block end
+#define OP_LEN          0x03
+#define OP_END          0x80
+#else
+#define WR_BYTE(addr, value) ram->setByte(addr, value)
+#define WR_WORD(addr, value) ram->setWord(addr, value)
 
-#define WR_BYTE(addr, value) write_byte(addr, value)
-#define WR_WORD(addr, value) write_word(addr, value)
+#define IMM8()          RD_CODE(PC++)
+#define IMM16()         RD_CODE16(PC)
+#endif
 
 
-#define FLAGS           regs.f
 #define AF              regs.af.w
 #define BC              regs.bc.w
 #define DE              regs.de.w
@@ -72,19 +116,41 @@
 #define F_ZERO          0x40
 #define F_NEG           0x80
 
-#define C_FLAG          FLAGS.carry_flag
-#define P_FLAG          FLAGS.parity_flag
-#define H_FLAG          FLAGS.half_carry_flag
-#define Z_FLAG          FLAGS.zero_flag
-#define S_FLAG          FLAGS.sign_flag
-#define UN1_FLAG        FLAGS.unused1
-#define UN3_FLAG        FLAGS.unused3
-#define UN5_FLAG        FLAGS.unused5
-
-#define SET(flag)       (flag = 1)
-#define CLR(flag)       (flag = 0)
-#define TST(flag)       (flag)
-#define CPL(flag)       (flag = !flag)
+#define C_FLAG          F_CARRY
+#define P_FLAG          F_PARITY
+#define H_FLAG          F_HCARRY
+#define Z_FLAG          F_ZERO
+#define S_FLAG          F_NEG
+
+#define SET(flag)       (F |= (flag))
+#define CLR(flag)       (F &= ~(flag))
+#define CPL(flag)       (F ^= (flag))
+#define CARRY           (F & F_CARRY)
+#define SETC(val)       (F = (F & ~F_CARRY) | ((val) & F_CARRY))
+
+#ifdef CPU_LAZY_FLAGS
+// Lazy flags: the carry is always up to date, the sign, zero, parity
+// and half carry flags are built from the last operation when needed
+#define LZ_NONE         0x00
+#define LZ_ADD          0x01
+#define LZ_SUB          0x02
+#define LZ_ANA          0x03
+#define LZ_LOG          0x04
+#define LZ_INR          0x05
+#define LZ_DCR          0x06
+
+#define LAZY(op, a, v, r) {                      \
+    regs.lazy   = (op);                          \
+    regs.lazy_a = (a);                           \
+    regs.lazy_v = (v);                           \
+    regs.lazy_r = (r);                           \
+  }
+#define EVAL_FLAGS()    { if (regs.lazy) eval_flags(); }
+#define TST(flag)       ((flag) != C_FLAG and regs.lazy ? eval_flags() : (void)0, F & (flag))
+#else
+#define EVAL_FLAGS()    { }
+#define TST(flag)       (F & (flag))
+#endif
 
 #define POP(reg)        { (reg) = RD_WORD(SP); SP += 2; }
 #define PUSH(reg)       { SP -= 2; WR_WORD(SP, (reg)); }
@@ -92,20 +158,81 @@
 #define STC()           { SET(C_FLAG); }
 #define CMC()           { CPL(C_FLAG); }
 
+#ifdef CPU_LAZY_FLAGS
 #define INR(reg) {                               \
     ++(reg);                                     \
-    S_FLAG = (((reg) & 0x80) != 0);              \
-    Z_FLAG = ((reg) == 0);                       \
-    H_FLAG = (((reg) & 0x0f) == 0);              \
-    P_FLAG = PARITY(reg);                        \
+    LAZY(LZ_INR, 0, 0, (reg));                   \
   }
 
 #define DCR(reg) {                               \
     --(reg);                                     \
-    S_FLAG = (((reg) & 0x80) != 0);              \
-    Z_FLAG = ((reg) == 0);                       \
-    H_FLAG = !(((reg) & 0x0f) == 0x0f);          \
-    P_FLAG = PARITY(reg);                        \
+    LAZY(LZ_DCR, 0, 0, (reg));                   \
+  }
+
+#define ADD(val) {                               \
+    work16 = (uns16)A + (val);                   \
+    LAZY(LZ_ADD, A, (val), work16);              \
+    A = work16 & 0xff;                           \
+    SETC(work16 >> 8);                           \
+  }
+
+#define ADC(val) {                               \
+    work16 = (uns16)A + (val) + CARRY;           \
+    LAZY(LZ_ADD, A, (val), work16);              \
+    A = work16 & 0xff;                           \
+    SETC(work16 >> 8);                           \
+  }
+
+#define SUB(val) {                               \
+    work16 = (uns16)A - (val);                   \
+    LAZY(LZ_SUB, A, (val), work16);              \
+    A = work16 & 0xff;                           \
+    SETC(work16 >> 8);                           \
+  }
+
+#define SBB(val) {                               \
+    work16 = (uns16)A - (val) - CARRY;           \
+    LAZY(LZ_SUB, A, (val), work16);              \
+    A = work16 & 0xff;                           \
+    SETC(work16 >> 8);                           \
+  }
+
+#define CMP(val) {                               \
+    work16 = (uns16)A - (val);                   \
+    LAZY(LZ_SUB, A, (val), work16);              \
+    SETC(work16 >> 8);                           \
+  }
+
+#define ANA(val) {                               \
+    LAZY(LZ_ANA, A, (val), A & (val));           \
+    A &= (val);                                  \
+    CLR(C_FLAG);                                 \
+  }
+
+#define XRA(val) {                               \
+    A ^= (val);                                  \
+    LAZY(LZ_LOG, 0, 0, A);                       \
+    CLR(C_FLAG);                                 \
+  }
+
+#define ORA(val) {                               \
+    A |= (val);                                  \
+    LAZY(LZ_LOG, 0, 0, A);                       \
+    CLR(C_FLAG);                                 \
+  }
+#else
+#define INR(reg) {                               \
+    ++(reg);                                     \
+    F = (F & F_CARRY) | szp_table[(reg)] |       \
+        (((reg) & 0x0f) == 0 ? F_HCARRY : 0) |   \
+        F_UN1;                                   \
+  }
+
+#define DCR(reg) {                               \
+    --(reg);                                     \
+    F = (F & F_CARRY) | szp_table[(reg)] |       \
+        (((reg) & 0x0f) == 0x0f ? 0 : F_HCARRY) |\
+        F_UN1;                                   \
   }
 
 #define ADD(val) {                               \
@@ -114,24 +241,20 @@
             (((val) & 0x88) >> 2) |              \
             ((work16 & 0x88) >> 3);              \
     A = work16 & 0xff;                           \
-    S_FLAG = ((A & 0x80) != 0);                  \
-    Z_FLAG = (A == 0);                           \
-    H_FLAG = half_carry_table[index & 0x7];      \
-    P_FLAG = PARITY(A);                          \
-    C_FLAG = ((work16 & 0x0100) != 0);           \
+    F = szp_table[A] |                           \
+        half_carry_table[index & 0x7] |          \
+        ((work16 >> 8) & F_CARRY) | F_UN1;       \
   }
 
 #define ADC(val) {                               \
-    work16 = (uns16)A + (val) + C_FLAG;          \
+    work16 = (uns16)A + (val) + CARRY;           \
     index = ((A & 0x88) >> 1) |                  \
             (((val) & 0x88) >> 2) |              \
             ((work16 & 0x88) >> 3);              \
     A = work16 & 0xff;                           \
-    S_FLAG = ((A & 0x80) != 0);                  \
-    Z_FLAG = (A == 0);                           \
-    H_FLAG = half_carry_table[index & 0x7];      \
-    P_FLAG = PARITY(A);                          \
-    C_FLAG = ((work16 & 0x0100) != 0);           \
+    F = szp_table[A] |                           \
+        half_carry_table[index & 0x7] |          \
+        ((work16 >> 8) & F_CARRY) | F_UN1;       \
   }
 
 #define SUB(val) {                               \
@@ -140,24 +263,20 @@
             (((val) & 0x88) >> 2) |              \
             ((work16 & 0x88) >> 3);              \
     A = work16 & 0xff;                           \
-    S_FLAG = ((A & 0x80) != 0);                  \
-    Z_FLAG = (A == 0);                           \
-    H_FLAG = !sub_half_carry_table[index & 0x7]; \
-    P_FLAG = PARITY(A);                          \
-    C_FLAG = ((work16 & 0x0100) != 0);           \
+    F = szp_table[A] |                           \
+        sub_half_carry_table[index & 0x7] |      \
+        ((work16 >> 8) & F_CARRY) | F_UN1;       \
   }
 
 #define SBB(val) {                               \
-    work16 = (uns16)A - (val) - C_FLAG;          \
+    work16 = (uns16)A - (val) - CARRY;           \
     index = ((A & 0x88) >> 1) |                  \
             (((val) & 0x88) >> 2) |              \
             ((work16 & 0x88) >> 3);              \
     A = work16 & 0xff;                           \
-    S_FLAG = ((A & 0x80) != 0);                  \
-    Z_FLAG = (A == 0);                           \
-    H_FLAG = !sub_half_carry_table[index & 0x7]; \
-    P_FLAG = PARITY(A);                          \
-    C_FLAG = ((work16 & 0x0100) != 0);           \
+    F = szp_table[A] |                           \
+        sub_half_carry_table[index & 0x7] |      \
+        ((work16 >> 8) & F_CARRY) | F_UN1;       \
   }
 
 #define CMP(val) {                               \
@@ -165,49 +284,39 @@
     index = ((A & 0x88) >> 1) |                  \
             (((val) & 0x88) >> 2) |              \
             ((work16 & 0x88) >> 3);              \
-    S_FLAG = ((work16 & 0x80) != 0);             \
-    Z_FLAG = ((work16 & 0xff) == 0);             \
-    H_FLAG = !sub_half_carry_table[index & 0x7]; \
-    C_FLAG = ((work16 & 0x0100) != 0);           \
-    P_FLAG = PARITY(work16 & 0xff);              \
+    F = szp_table[work16 & 0xff] |               \
+        sub_half_carry_table[index & 0x7] |      \
+        ((work16 >> 8) & F_CARRY) | F_UN1;       \
   }
 
 #define ANA(val) {                               \
-    H_FLAG = ((A | val) & 0x08) != 0;            \
+    index = ((A | (val)) & 0x08) << 1;           \
     A &= (val);                                  \
-    S_FLAG = ((A & 0x80) != 0);                  \
-    Z_FLAG = (A == 0);                           \
-    P_FLAG = PARITY(A);                          \
-    CLR(C_FLAG);                                 \
+    F = szp_table[A] | index | F_UN1;            \
   }
 
 #define XRA(val) {                               \
     A ^= (val);                                  \
-    S_FLAG = ((A & 0x80) != 0);                  \
-    Z_FLAG = (A == 0);                           \
-    CLR(H_FLAG);                                 \
-    P_FLAG = PARITY(A);                          \
-    CLR(C_FLAG);                                 \
+    F = szp_table[A] | F_UN1;                    \
   }
 
 #define ORA(val) {                               \
     A |= (val);                                  \
-    S_FLAG = ((A & 0x80) != 0);                  \
-    Z_FLAG = (A == 0);                           \
-    CLR(H_FLAG);                                 \
-    P_FLAG = PARITY(A);                          \
-    CLR(C_FLAG);                                 \
+    F = szp_table[A] | F_UN1;                    \
   }
+#endif
 
 #define DAD(reg) {                               \
     work32 = (uns32)HL + (reg);                  \
     HL = work32 & 0xffff;                        \
-    C_FLAG = ((work32 & 0x10000L) != 0);         \
+    SETC(work32 >> 16);                          \
   }
 
+// The target is fetched before the push, as the real CPU does
 #define CALL {                                   \
+    work16 = IMM16();                            \
     PUSH(PC + 2);                                \
-    PC = RD_WORD(PC);                            \
+    PC = work16;                                 \
   }
 
 #define RST(addr) {                              \
@@ -215,1071 +324,1214 @@
     PC = (addr);                                 \
   }
 
-#define PARITY(reg) getParity(reg)
-
-
-//int parity_table[] = {
-//    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-//    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-//    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-//    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-//    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-//    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-//    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-//    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-//    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-//    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-//    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-//    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-//    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-//    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-//    0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-//    1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-//};
-
-int getParity(int val) {
-  val ^= val >> 4;
-  val &= 0xf;
-  return !((0x6996 >> val) & 1);
-}
-
-int half_carry_table[]     = { 0, 0, 1, 0, 1, 0, 1, 1 };
-int sub_half_carry_table[] = { 0, 1, 1, 1, 0, 0, 0, 1 };
-
-I8080::I8080() {
+#ifdef CPU_FAST_TRAP
+// Jumps into the BDOS and BIOS entry stubs run them natively
+#define TRAP() {                                 \
+    if (PC >= BDOSENTRY and trap()) {            \
+      cycles += 20;                              \
+      BREAK_RUN();                               \
+    }                                            \
+  }
+#else
+#define TRAP()
+#endif
+
+
+#ifdef CPU_THREADED
+// Threaded dispatch: each handler fetches the next opcode and jumps
+// straight to its handler, until the cycles budget is spent
+#define OPCODE(op)      case op: op_##op:
+#define NEXT {                                   \
+    total += cycles;                             \
+    if (total >= budget or not state) break;     \
+    FETCH();                                     \
+    goto *handlers[opcode];                      \
+  }
+#ifdef CPU_BLOCKS
+// Fetch the next micro-op, from the current or the next block; the
+// last successor of each block is linked to skip the lookup
+#define FETCH() {                                \
+    if (++uop >= uend) {                         \
+      if (blk->next->pc != PC or                 \
+          blk->next->len == 0)                   \
+        blk->next = lookup(PC);                  \
+      blk = blk->next;                           \
+      uop = blk->ops;                            \
+      uend = uop + blk->len;                     \
+    }                                            \
+    PC++;                                        \
+    this->opcode = opcode = uop->op;             \
+  }
+#else
+#define FETCH() {                                \
+    this->opcode = opcode = RD_CODE(PC++);       \
+  }
+#endif
+// End the run after this instruction
+#define BREAK_RUN()     (budget = 0)
+#else
+// Switch dispatch: one opcode per call
+#define OPCODE(op)      case op:
+#define NEXT            break
+// End the run after this instruction
+#define BREAK_RUN()     (trapped = true)
+#endif
+
+
+// Sign, zero and parity flags of each byte value
+static const uns8 szp_table[256] = {
+  0x44, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+  0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+  0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+  0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+  0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+  0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+  0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+  0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04, 0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+  0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+  0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+  0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+  0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+  0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+  0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+  0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+  0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80, 0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84
+};
+
+// Half carry flag, indexed by bits 3 of the operands and of the result
+static const uns8 half_carry_table[]     = { 0, 0, F_HCARRY, 0, F_HCARRY, 0, F_HCARRY, F_HCARRY };
+static const uns8 sub_half_carry_table[] = { F_HCARRY, 0, 0, 0, F_HCARRY, F_HCARRY, F_HCARRY, 0 };
+
+#ifdef CPU_BLOCKS
+// Instruction length and block end flag of each opcode
+static const uns8 op_info[256] = {
+  0x01, 0x03, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01,
+  0x01, 0x03, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x01,
+  0x01, 0x03, 0x03, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x03, 0x01, 0x01, 0x01, 0x02, 0x01,
+  0x01, 0x03, 0x03, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x01, 0x03, 0x01, 0x01, 0x01, 0x02, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x81, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+  0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+  0x81, 0x01, 0x83, 0x83, 0x83, 0x01, 0x02, 0x81, 0x81, 0x81, 0x83, 0x83, 0x83, 0x83, 0x02, 0x81,
+  0x81, 0x01, 0x83, 0x82, 0x83, 0x01, 0x02, 0x81, 0x81, 0x81, 0x83, 0x82, 0x83, 0x83, 0x02, 0x81,
+  0x81, 0x01, 0x83, 0x01, 0x83, 0x01, 0x02, 0x81, 0x81, 0x81, 0x83, 0x01, 0x83, 0x83, 0x02, 0x81,
+  0x81, 0x01, 0x83, 0x81, 0x83, 0x01, 0x02, 0x81, 0x81, 0x01, 0x83, 0x81, 0x83, 0x83, 0x02, 0x81
+};
+#endif
+
+I8080::I8080(RAM *ram): ram(ram) {
 }
 
 I8080::~I8080() {
 }
 
 void I8080::init(void) {
-  C_FLAG = 0;
-  S_FLAG = 0;
-  Z_FLAG = 0;
-  H_FLAG = 0;
-  P_FLAG = 0;
-  UN1_FLAG = 1;
-  UN3_FLAG = 0;
-  UN5_FLAG = 0;
+  // Clear the register file
+  memset(&regs, 0, sizeof(regs));
+  // UN1 is always 1, UN3 and UN5 are always 0
+  F = F_UN1;
+  // Drop all translated code
+  invalidate(0x0000, 0x10000);
 
   PC = 0xF800;
 }
 
 void I8080::store_flags(void) {
-  if (S_FLAG) F |= F_NEG;      else F &= ~F_NEG;
-  if (Z_FLAG) F |= F_ZERO;     else F &= ~F_ZERO;
-  if (H_FLAG) F |= F_HCARRY;   else F &= ~F_HCARRY;
-  if (P_FLAG) F |= F_PARITY;   else F &= ~F_PARITY;
-  if (C_FLAG) F |= F_CARRY;    else F &= ~F_CARRY;
-  F |=  F_UN1;   // UN1_FLAG is always 1.
-  F &= ~F_UN3;   // UN3_FLAG is always 0.
-  F &= ~F_UN5;   // UN5_FLAG is always 0.
+  EVAL_FLAGS();
 }
 
 void I8080::retrieve_flags(void) {
-  S_FLAG = F & F_NEG      ? 1 : 0;
-  Z_FLAG = F & F_ZERO     ? 1 : 0;
-  H_FLAG = F & F_HCARRY   ? 1 : 0;
-  P_FLAG = F & F_PARITY   ? 1 : 0;
-  C_FLAG = F & F_CARRY    ? 1 : 0;
+  F = (F | F_UN1) & ~(F_UN3 | F_UN5);
+#ifdef CPU_LAZY_FLAGS
+  regs.lazy = LZ_NONE;
+#endif
 }
 
+#ifdef CPU_LAZY_FLAGS
+void I8080::eval_flags(void) {
+  uns8 res = regs.lazy_r;
+  uns8 hc;
+  index = ((regs.lazy_a & 0x88) >> 1) |
+          ((regs.lazy_v & 0x88) >> 2) |
+          ((res & 0x88) >> 3);
+  switch (regs.lazy) {
+    case LZ_ADD:
+      hc = half_carry_table[index & 0x7];
+      break;
+    case LZ_SUB:
+      hc = sub_half_carry_table[index & 0x7];
+      break;
+    case LZ_ANA:
+      hc = ((regs.lazy_a | regs.lazy_v) & 0x08) << 1;
+      break;
+    case LZ_INR:
+      hc = (res & 0x0f) == 0 ? F_HCARRY : 0;
+      break;
+    case LZ_DCR:
+      hc = (res & 0x0f) == 0x0f ? 0 : F_HCARRY;
+      break;
+    default:
+      hc = 0;
+      break;
+  }
+  F = (F & F_CARRY) | szp_table[res] | hc | F_UN1;
+  regs.lazy = LZ_NONE;
+}
+#endif
+
+#ifdef CPU_THREADED
+int I8080::execute(int budget) {
+  // Opcode handlers
+  static const void* const handlers[256] = {
+    &&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07,
+    &&op_0x08, &&op_0x09, &&op_0x0A, &&op_0x0B, &&op_0x0C, &&op_0x0D, &&op_0x0E, &&op_0x0F,
+    &&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17,
+    &&op_0x18, &&op_0x19, &&op_0x1A, &&op_0x1B, &&op_0x1C, &&op_0x1D, &&op_0x1E, &&op_0x1F,
+    &&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27,
+    &&op_0x28, &&op_0x29, &&op_0x2A, &&op_0x2B, &&op_0x2C, &&op_0x2D, &&op_0x2E, &&op_0x2F,
+    &&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37,
+    &&op_0x38, &&op_0x39, &&op_0x3A, &&op_0x3B, &&op_0x3C, &&op_0x3D, &&op_0x3E, &&op_0x3F,
+    &&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47,
+    &&op_0x48, &&op_0x49, &&op_0x4A, &&op_0x4B, &&op_0x4C, &&op_0x4D, &&op_0x4E, &&op_0x4F,
+    &&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57,
+    &&op_0x58, &&op_0x59, &&op_0x5A, &&op_0x5B, &&op_0x5C, &&op_0x5D, &&op_0x5E, &&op_0x5F,
+    &&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67,
+    &&op_0x68, &&op_0x69, &&op_0x6A, &&op_0x6B, &&op_0x6C, &&op_0x6D, &&op_0x6E, &&op_0x6F,
+    &&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77,
+    &&op_0x78, &&op_0x79, &&op_0x7A, &&op_0x7B, &&op_0x7C, &&op_0x7D, &&op_0x7E, &&op_0x7F,
+    &&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87,
+    &&op_0x88, &&op_0x89, &&op_0x8A, &&op_0x8B, &&op_0x8C, &&op_0x8D, &&op_0x8E, &&op_0x8F,
+    &&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97,
+    &&op_0x98, &&op_0x99, &&op_0x9A, &&op_0x9B, &&op_0x9C, &&op_0x9D, &&op_0x9E, &&op_0x9F,
+    &&op_0xA0, &&op_0xA1, &&op_0xA2, &&op_0xA3, &&op_0xA4, &&op_0xA5, &&op_0xA6, &&op_0xA7,
+    &&op_0xA8, &&op_0xA9, &&op_0xAA, &&op_0xAB, &&op_0xAC, &&op_0xAD, &&op_0xAE, &&op_0xAF,
+    &&op_0xB0, &&op_0xB1, &&op_0xB2, &&op_0xB3, &&op_0xB4, &&op_0xB5, &&op_0xB6, &&op_0xB7,
+    &&op_0xB8, &&op_0xB9, &&op_0xBA, &&op_0xBB, &&op_0xBC, &&op_0xBD, &&op_0xBE, &&op_0xBF,
+    &&op_0xC0, &&op_0xC1, &&op_0xC2, &&op_0xC3, &&op_0xC4, &&op_0xC5, &&op_0xC6, &&op_0xC7,
+    &&op_0xC8, &&op_0xC9, &&op_0xCA, &&op_0xCB, &&op_0xCC, &&op_0xCD, &&op_0xCE, &&op_0xCF,
+    &&op_0xD0, &&op_0xD1, &&op_0xD2, &&op_0xD3, &&op_0xD4, &&op_0xD5, &&op_0xD6, &&op_0xD7,
+    &&op_0xD8, &&op_0xD9, &&op_0xDA, &&op_0xDB, &&op_0xDC, &&op_0xDD, &&op_0xDE, &&op_0xDF,
+    &&op_0xE0, &&op_0xE1, &&op_0xE2, &&op_0xE3, &&op_0xE4, &&op_0xE5, &&op_0xE6, &&op_0xE7,
+    &&op_0xE8, &&op_0xE9, &&op_0xEA, &&op_0xEB, &&op_0xEC, &&op_0xED, &&op_0xEE, &&op_0xEF,
+    &&op_0xF0, &&op_0xF1, &&op_0xF2, &&op_0xF3, &&op_0xF4, &&op_0xF5, &&op_0xF6, &&op_0xF7,
+    &&op_0xF8, &&op_0xF9, &&op_0xFA, &&op_0xFB, &&op_0xFC, &&op_0xFD, &&op_0xFE, &&op_0xFF
+  };
+  int opcode, cycles, total = 0;
+#ifdef CPU_BLOCKS
+  block_t *blk;
+  uop_t   *uop, *uend;
+  uns16   waddr;
+  // Start with a block lookup
+  blk = blocks;
+  uop = uend = blk->ops;
+#endif
+  FETCH();
+#else
 int I8080::execute(int opcode) {
   int cycles;
+#endif
   this->opcode = opcode;
   switch (opcode) {
-    case 0x00:            /* nop */
+    OPCODE(0x00)          /* nop */
     // Undocumented NOP.
-    case 0x08:            /* nop */
-    case 0x10:            /* nop */
-    case 0x18:            /* nop */
-    case 0x20:            /* nop */
-    case 0x28:            /* nop */
-    case 0x30:            /* nop */
-    case 0x38:            /* nop */
+    OPCODE(0x08)          /* nop */
+    OPCODE(0x10)          /* nop */
+    OPCODE(0x18)          /* nop */
+    OPCODE(0x20)          /* nop */
+    OPCODE(0x28)          /* nop */
+    OPCODE(0x30)          /* nop */
+    OPCODE(0x38)          /* nop */
       cycles = 4;
-      break;
+      NEXT;
 
-    case 0x01:            /* lxi b, data16 */
+    OPCODE(0x01)          /* lxi b, data16 */
       cycles = 10;
-      BC = RD_WORD(PC);
+      BC = IMM16();
       PC += 2;
-      break;
+      NEXT;
 
-    case 0x02:            /* stax b */
+    OPCODE(0x02)          /* stax b */
       cycles = 7;
       WR_BYTE(BC, A);
-      break;
+      NEXT;
 
-    case 0x03:            /* inx b */
+    OPCODE(0x03)          /* inx b */
       cycles = 5;
       BC++;
-      break;
+      NEXT;
 
-    case 0x04:            /* inr b */
+    OPCODE(0x04)          /* inr b */
       cycles = 5;
       INR(B);
-      break;
+      NEXT;
 
-    case 0x05:            /* dcr b */
+    OPCODE(0x05)          /* dcr b */
       cycles = 5;
       DCR(B);
-      break;
+      NEXT;
 
-    case 0x06:            /* mvi b, data8 */
+    OPCODE(0x06)          /* mvi b, data8 */
       cycles = 7;
-      B = RD_BYTE(PC++);
-      break;
+      B = IMM8();
+      NEXT;
 
-    case 0x07:            /* rlc */
+    OPCODE(0x07)          /* rlc */
       cycles = 4;
-      C_FLAG = ((A & 0x80) != 0);
-      A = (A << 1) | C_FLAG;
-      break;
+      work8 = A >> 7;
+      SETC(work8);
+      A = (A << 1) | work8;
+      NEXT;
 
-    case 0x09:            /* dad b */
+    OPCODE(0x09)          /* dad b */
       cycles = 10;
       DAD(BC);
-      break;
+      NEXT;
 
-    case 0x0A:            /* ldax b */
+    OPCODE(0x0A)          /* ldax b */
       cycles = 7;
       A = RD_BYTE(BC);
-      break;
+      NEXT;
 
-    case 0x0B:            /* dcx b */
+    OPCODE(0x0B)          /* dcx b */
       cycles = 5;
       BC--;
-      break;
+      NEXT;
 
-    case 0x0C:            /* inr c */
+    OPCODE(0x0C)          /* inr c */
       cycles = 5;
       INR(C);
-      break;
+      NEXT;
 
-    case 0x0D:            /* dcr c */
+    OPCODE(0x0D)          /* dcr c */
       cycles = 5;
       DCR(C);
-      break;
+      NEXT;
 
-    case 0x0E:            /* mvi c, data8 */
+    OPCODE(0x0E)          /* mvi c, data8 */
       cycles = 7;
-      C = RD_BYTE(PC++);
-      break;
+      C = IMM8();
+      NEXT;
 
-    case 0x0F:            /* rrc */
+    OPCODE(0x0F)          /* rrc */
       cycles = 4;
-      C_FLAG = A & 0x01;
-      A = (A >> 1) | (C_FLAG << 7);
-      break;
+      work8 = A & 0x01;
+      SETC(work8);
+      A = (A >> 1) | (work8 << 7);
+      NEXT;
 
-    case 0x11:            /* lxi d, data16 */
+    OPCODE(0x11)          /* lxi d, data16 */
       cycles = 10;
-      DE = RD_WORD(PC);
+      DE = IMM16();
       PC += 2;
-      break;
+      NEXT;
 
-    case 0x12:            /* stax d */
+    OPCODE(0x12)          /* stax d */
       cycles = 7;
       WR_BYTE(DE, A);
-      break;
+      NEXT;
 
-    case 0x13:            /* inx d */
+    OPCODE(0x13)          /* inx d */
       cycles = 5;
       DE++;
-      break;
+      NEXT;
 
-    case 0x14:            /* inr d */
+    OPCODE(0x14)          /* inr d */
       cycles = 5;
       INR(D);
-      break;
+      NEXT;
 
-    case 0x15:            /* dcr d */
+    OPCODE(0x15)          /* dcr d */
       cycles = 5;
       DCR(D);
-      break;
+      NEXT;
 
-    case 0x16:            /* mvi d, data8 */
+    OPCODE(0x16)          /* mvi d, data8 */
       cycles = 7;
-      D = RD_BYTE(PC++);
-      break;
+      D = IMM8();
+      NEXT;
 
-    case 0x17:            /* ral */
+    OPCODE(0x17)          /* ral */
       cycles = 4;
-      work8 = (uns8)C_FLAG;
-      C_FLAG = ((A & 0x80) != 0);
+      work8 = CARRY;
+      SETC(A >> 7);
       A = (A << 1) | work8;
-      break;
+      NEXT;
 
-    case 0x19:            /* dad d */
+    OPCODE(0x19)          /* dad d */
       cycles = 10;
       DAD(DE);
-      break;
+      NEXT;
 
-    case 0x1A:            /* ldax d */
+    OPCODE(0x1A)          /* ldax d */
       cycles = 7;
       A = RD_BYTE(DE);
-      break;
+      NEXT;
 
-    case 0x1B:            /* dcx d */
+    OPCODE(0x1B)          /* dcx d */
       cycles = 5;
       DE--;
-      break;
+      NEXT;
 
-    case 0x1C:            /* inr e */
+    OPCODE(0x1C)          /* inr e */
       cycles = 5;
       INR(E);
-      break;
+      NEXT;
 
-    case 0x1D:            /* dcr e */
+    OPCODE(0x1D)          /* dcr e */
       cycles = 5;
       DCR(E);
-      break;
+      NEXT;
 
-    case 0x1E:            /* mvi e, data8 */
+    OPCODE(0x1E)          /* mvi e, data8 */
       cycles = 7;
-      E = RD_BYTE(PC++);
-      break;
+      E = IMM8();
+      NEXT;
 
-    case 0x1F:             /* rar */
+    OPCODE(0x1F)           /* rar */
       cycles = 4;
-      work8 = (uns8)C_FLAG;
-      C_FLAG = A & 0x01;
+      work8 = CARRY;
+      SETC(A);
       A = (A >> 1) | (work8 << 7);
-      break;
+      NEXT;
 
-    case 0x21:             /* lxi h, data16 */
+    OPCODE(0x21)           /* lxi h, data16 */
       cycles = 10;
-      HL = RD_WORD(PC);
+      HL = IMM16();
       PC += 2;
-      break;
+      NEXT;
 
-    case 0x22:            /* shld addr */
+    OPCODE(0x22)          /* shld addr */
       cycles = 16;
-      WR_WORD(RD_WORD(PC), HL);
+      WR_WORD(IMM16(), HL);
       PC += 2;
-      break;
+      NEXT;
 
-    case 0x23:            /* inx h */
+    OPCODE(0x23)          /* inx h */
       cycles = 5;
       HL++;
-      break;
+      NEXT;
 
-    case 0x24:            /* inr h */
+    OPCODE(0x24)          /* inr h */
       cycles = 5;
       INR(H);
-      break;
+      NEXT;
 
-    case 0x25:            /* dcr h */
+    OPCODE(0x25)          /* dcr h */
       cycles = 5;
       DCR(H);
-      break;
+      NEXT;
 
-    case 0x26:            /* mvi h, data8 */
+    OPCODE(0x26)          /* mvi h, data8 */
       cycles = 7;
-      H = RD_BYTE(PC++);
-      break;
+      H = IMM8();
+      NEXT;
 
-    case 0x27:            /* daa */
+    OPCODE(0x27)          /* daa */
       cycles = 4;
-      carry = (uns8)C_FLAG;
+      carry = CARRY;
       add = 0;
-      if (H_FLAG || (A & 0x0f) > 9) {
+      if (TST(H_FLAG) || (A & 0x0f) > 9) {
         add = 0x06;
       }
-      if (C_FLAG || (A >> 4) > 9 || ((A >> 4) >= 9 && (A & 0x0f) > 9)) {
+      if (carry || (A >> 4) > 9 || ((A >> 4) >= 9 && (A & 0x0f) > 9)) {
         add |= 0x60;
         carry = 1;
       }
       ADD(add);
-      P_FLAG = PARITY(A);
-      C_FLAG = carry;
-      break;
+      SETC(carry);
+      NEXT;
 
-    case 0x29:            /* dad hl */
+    OPCODE(0x29)          /* dad hl */
       cycles = 10;
       DAD(HL);
-      break;
+      NEXT;
 
-    case 0x2A:            /* ldhl addr */
+    OPCODE(0x2A)          /* ldhl addr */
       cycles = 16;
-      HL = RD_WORD(RD_WORD(PC));
+      HL = RD_WORD(IMM16());
       PC += 2;
-      break;
+      NEXT;
 
-    case 0x2B:            /* dcx h */
+    OPCODE(0x2B)          /* dcx h */
       cycles = 5;
       HL--;
-      break;
+      NEXT;
 
-    case 0x2C:            /* inr l */
+    OPCODE(0x2C)          /* inr l */
       cycles = 5;
       INR(L);
-      break;
+      NEXT;
 
-    case 0x2D:            /* dcr l */
+    OPCODE(0x2D)          /* dcr l */
       cycles = 5;
       DCR(L);
-      break;
+      NEXT;
 
-    case 0x2E:            /* mvi l, data8 */
+    OPCODE(0x2E)          /* mvi l, data8 */
       cycles = 7;
-      L = RD_BYTE(PC++);
-      break;
+      L = IMM8();
+      NEXT;
 
-    case 0x2F:            /* cma */
+    OPCODE(0x2F)          /* cma */
       cycles = 4;
       A ^= 0xff;
-      break;
+      NEXT;
 
-    case 0x31:            /* lxi sp, data16 */
+    OPCODE(0x31)          /* lxi sp, data16 */
       cycles = 10;
-      SP = RD_WORD(PC);
+      SP = IMM16();
       PC += 2;
-      break;
+      NEXT;
 
-    case 0x32:            /* sta addr */
+    OPCODE(0x32)          /* sta addr */
       cycles = 13;
-      WR_BYTE(RD_WORD(PC), A);
+      WR_BYTE(IMM16(), A);
       PC += 2;
-      break;
+      NEXT;
 
-    case 0x33:            /* inx sp */
+    OPCODE(0x33)          /* inx sp */
       cycles = 5;
       SP++;
-      break;
+      NEXT;
 
-    case 0x34:            /* inr m */
+    OPCODE(0x34)          /* inr m */
       cycles = 10;
       work8 = RD_BYTE(HL);
       INR(work8);
       WR_BYTE(HL, work8);
-      break;
+      NEXT;
 
-    case 0x35:            /* dcr m */
+    OPCODE(0x35)          /* dcr m */
       cycles = 10;
       work8 = RD_BYTE(HL);
       DCR(work8);
       WR_BYTE(HL, work8);
-      break;
+      NEXT;
 
-    case 0x36:            /* mvi m, data8 */
+    OPCODE(0x36)          /* mvi m, data8 */
       cycles = 10;
-      WR_BYTE(HL, RD_BYTE(PC++));
-      break;
+      WR_BYTE(HL, IMM8());
+      NEXT;
 
-    case 0x37:            /* stc */
+    OPCODE(0x37)          /* stc */
       cycles = 4;
       SET(C_FLAG);
-      break;
+      NEXT;
 
-    case 0x39:            /* dad sp */
+    OPCODE(0x39)          /* dad sp */
       cycles = 10;
       DAD(SP);
-      break;
+      NEXT;
 
-    case 0x3A:            /* lda addr */
+    OPCODE(0x3A)          /* lda addr */
       cycles = 13;
-      A = RD_BYTE(RD_WORD(PC));
+      A = RD_BYTE(IMM16());
       PC += 2;
-      break;
+      NEXT;
 
-    case 0x3B:            /* dcx sp */
+    OPCODE(0x3B)          /* dcx sp */
       cycles = 5;
       SP--;
-      break;
+      NEXT;
 
-    case 0x3C:            /* inr a */
+    OPCODE(0x3C)          /* inr a */
       cycles = 5;
       INR(A);
-      break;
+      NEXT;
 
-    case 0x3D:            /* dcr a */
+    OPCODE(0x3D)          /* dcr a */
       cycles = 5;
       DCR(A);
-      break;
+      NEXT;
 
-    case 0x3E:            /* mvi a, data8 */
+    OPCODE(0x3E)          /* mvi a, data8 */
       cycles = 7;
-      A = RD_BYTE(PC++);
-      break;
+      A = IMM8();
+      NEXT;
 
-    case 0x3F:            /* cmc */
+    OPCODE(0x3F)          /* cmc */
       cycles = 4;
       CPL(C_FLAG);
-      break;
+      NEXT;
 
-    case 0x40:            /* mov b, b */
+    OPCODE(0x40)          /* mov b, b */
       cycles = 4;
-      break;
+      NEXT;
 
-    case 0x41:            /* mov b, c */
+    OPCODE(0x41)          /* mov b, c */
       cycles = 5;
       B = C;
-      break;
+      NEXT;
 
-    case 0x42:            /* mov b, d */
+    OPCODE(0x42)          /* mov b, d */
       cycles = 5;
       B = D;
-      break;
+      NEXT;
 
-    case 0x43:            /* mov b, e */
+    OPCODE(0x43)          /* mov b, e */
       cycles = 5;
       B = E;
-      break;
+      NEXT;
 
-    case 0x44:            /* mov b, h */
+    OPCODE(0x44)          /* mov b, h */
       cycles = 5;
       B = H;
-      break;
+      NEXT;
 
-    case 0x45:            /* mov b, l */
+    OPCODE(0x45)          /* mov b, l */
       cycles = 5;
       B = L;
-      break;
+      NEXT;
 
-    case 0x46:            /* mov b, m */
+    OPCODE(0x46)          /* mov b, m */
       cycles = 7;
       B = RD_BYTE(HL);
-      break;
+      NEXT;
 
-    case 0x47:            /* mov b, a */
+    OPCODE(0x47)          /* mov b, a */
       cycles = 5;
       B = A;
-      break;
+      NEXT;
 
-    case 0x48:            /* mov c, b */
+    OPCODE(0x48)          /* mov c, b */
       cycles = 5;
       C = B;
-      break;
+      NEXT;
 
-    case 0x49:            /* mov c, c */
+    OPCODE(0x49)          /* mov c, c */
       cycles = 5;
-      break;
+      NEXT;
 
-    case 0x4A:            /* mov c, d */
+    OPCODE(0x4A)          /* mov c, d */
       cycles = 5;
       C = D;
-      break;
+      NEXT;
 
-    case 0x4B:            /* mov c, e */
+    OPCODE(0x4B)          /* mov c, e */
       cycles = 5;
       C = E;
-      break;
+      NEXT;
 
-    case 0x4C:            /* mov c, h */
+    OPCODE(0x4C)          /* mov c, h */
       cycles = 5;
       C = H;
-      break;
+      NEXT;
 
-    case 0x4D:            /* mov c, l */
+    OPCODE(0x4D)          /* mov c, l */
       cycles = 5;
       C = L;
-      break;
+      NEXT;
 
-    case 0x4E:            /* mov c, m */
+    OPCODE(0x4E)          /* mov c, m */
       cycles = 7;
       C = RD_BYTE(HL);
-      break;
+      NEXT;
 
-    case 0x4F:            /* mov c, a */
+    OPCODE(0x4F)          /* mov c, a */
       cycles = 5;
       C = A;
-      break;
+      NEXT;
 
-    case 0x50:            /* mov d, b */
+    OPCODE(0x50)          /* mov d, b */
       cycles = 5;
       D = B;
-      break;
+      NEXT;
 
-    case 0x51:            /* mov d, c */
+    OPCODE(0x51)          /* mov d, c */
       cycles = 5;
       D = C;
-      break;
+      NEXT;
 
-    case 0x52:            /* mov d, d */
+    OPCODE(0x52)          /* mov d, d */
       cycles = 5;
-      break;
+      NEXT;
 
-    case 0x53:            /* mov d, e */
+    OPCODE(0x53)          /* mov d, e */
       cycles = 5;
       D = E;
-      break;
+      NEXT;
 
-    case 0x54:            /* mov d, h */
+    OPCODE(0x54)          /* mov d, h */
       cycles = 5;
       D = H;
-      break;
+      NEXT;
 
-    case 0x55:            /* mov d, l */
+    OPCODE(0x55)          /* mov d, l */
       cycles = 5;
       D = L;
-      break;
+      NEXT;
 
-    case 0x56:            /* mov d, m */
+    OPCODE(0x56)          /* mov d, m */
       cycles = 7;
       D = RD_BYTE(HL);
-      break;
+      NEXT;
 
-    case 0x57:            /* mov d, a */
+    OPCODE(0x57)          /* mov d, a */
       cycles = 5;
       D = A;
-      break;
+      NEXT;
 
-    case 0x58:            /* mov e, b */
+    OPCODE(0x58)          /* mov e, b */
       cycles = 5;
       E = B;
-      break;
+      NEXT;
 
-    case 0x59:            /* mov e, c */
+    OPCODE(0x59)          /* mov e, c */
       cycles = 5;
       E = C;
-      break;
+      NEXT;
 
-    case 0x5A:            /* mov e, d */
+    OPCODE(0x5A)          /* mov e, d */
       cycles = 5;
       E = D;
-      break;
+      NEXT;
 
-    case 0x5B:            /* mov e, e */
+    OPCODE(0x5B)          /* mov e, e */
       cycles = 5;
-      break;
+      NEXT;
 
-    case 0x5C:            /* mov c, h */
+    OPCODE(0x5C)          /* mov c, h */
       cycles = 5;
       E = H;
-      break;
+      NEXT;
 
-    case 0x5D:             /* mov c, l */
+    OPCODE(0x5D)           /* mov c, l */
       cycles = 5;
       E = L;
-      break;
+      NEXT;
 
-    case 0x5E:            /* mov c, m */
+    OPCODE(0x5E)          /* mov c, m */
       cycles = 7;
       E = RD_BYTE(HL);
-      break;
+      NEXT;
 
-    case 0x5F:            /* mov c, a */
+    OPCODE(0x5F)          /* mov c, a */
       cycles = 5;
       E = A;
-      break;
+      NEXT;
 
-    case 0x60:            /* mov h, b */
+    OPCODE(0x60)          /* mov h, b */
       cycles = 5;
       H = B;
-      break;
+      NEXT;
 
-    case 0x61:            /* mov h, c */
+    OPCODE(0x61)          /* mov h, c */
       cycles = 5;
       H = C;
-      break;
+      NEXT;
 
-    case 0x62:            /* mov h, d */
+    OPCODE(0x62)          /* mov h, d */
       cycles = 5;
       H = D;
-      break;
+      NEXT;
 
-    case 0x63:            /* mov h, e */
+    OPCODE(0x63)          /* mov h, e */
       cycles = 5;
       H = E;
-      break;
+      NEXT;
 
-    case 0x64:            /* mov h, h */
+    OPCODE(0x64)          /* mov h, h */
       cycles = 5;
-      break;
+      NEXT;
 
-    case 0x65:            /* mov h, l */
+    OPCODE(0x65)          /* mov h, l */
       cycles = 5;
       H = L;
-      break;
+      NEXT;
 
-    case 0x66:            /* mov h, m */
+    OPCODE(0x66)          /* mov h, m */
       cycles = 7;
       H = RD_BYTE(HL);
-      break;
+      NEXT;
 
-    case 0x67:            /* mov h, a */
+    OPCODE(0x67)          /* mov h, a */
       cycles = 5;
       H = A;
-      break;
+      NEXT;
 
-    case 0x68:            /* mov l, b */
+    OPCODE(0x68)          /* mov l, b */
       cycles = 5;
       L = B;
-      break;
+      NEXT;
 
-    case 0x69:            /* mov l, c */
+    OPCODE(0x69)          /* mov l, c */
       cycles = 5;
       L = C;
-      break;
+      NEXT;
 
-    case 0x6A:            /* mov l, d */
+    OPCODE(0x6A)          /* mov l, d */
       cycles = 5;
       L = D;
-      break;
+      NEXT;
 
-    case 0x6B:            /* mov l, e */
+    OPCODE(0x6B)          /* mov l, e */
       cycles = 5;
       L = E;
-      break;
+      NEXT;
 
-    case 0x6C:            /* mov l, h */
+    OPCODE(0x6C)          /* mov l, h */
       cycles = 5;
       L = H;
-      break;
+      NEXT;
 
-    case 0x6D:            /* mov l, l */
+    OPCODE(0x6D)          /* mov l, l */
       cycles = 5;
-      break;
+      NEXT;
 
-    case 0x6E:            /* mov l, m */
+    OPCODE(0x6E)          /* mov l, m */
       cycles = 7;
       L = RD_BYTE(HL);
-      break;
+      NEXT;
 
-    case 0x6F:            /* mov l, a */
+    OPCODE(0x6F)          /* mov l, a */
       cycles = 5;
       L = A;
-      break;
+      NEXT;
 
-    case 0x70:            /* mov m, b */
+    OPCODE(0x70)          /* mov m, b */
       cycles = 7;
       WR_BYTE(HL, B);
-      break;
+      NEXT;
 
-    case 0x71:            /* mov m, c */
+    OPCODE(0x71)          /* mov m, c */
       cycles = 7;
       WR_BYTE(HL, C);
-      break;
+      NEXT;
 
-    case 0x72:            /* mov m, d */
+    OPCODE(0x72)          /* mov m, d */
       cycles = 7;
       WR_BYTE(HL, D);
-      break;
+      NEXT;
 
-    case 0x73:            /* mov m, e */
+    OPCODE(0x73)          /* mov m, e */
       cycles = 7;
       WR_BYTE(HL, E);
-      break;
+      NEXT;
 
-    case 0x74:            /* mov m, h */
+    OPCODE(0x74)          /* mov m, h */
       cycles = 7;
       WR_BYTE(HL, H);
-      break;
+      NEXT;
 
-    case 0x75:            /* mov m, l */
+    OPCODE(0x75)          /* mov m, l */
       cycles = 7;
       WR_BYTE(HL, L);
-      break;
+      NEXT;
 
-    case 0x76:            /* hlt */
+    OPCODE(0x76)          /* hlt */
       cycles = 4;
       PC--;
-      break;
+      BREAK_RUN();
+      NEXT;
 
-    case 0x77:            /* mov m, a */
+    OPCODE(0x77)          /* mov m, a */
       cycles = 7;
       WR_BYTE(HL, A);
-      break;
+      NEXT;
 
-    case 0x78:            /* mov a, b */
+    OPCODE(0x78)          /* mov a, b */
       cycles = 5;
       A = B;
-      break;
+      NEXT;
 
-    case 0x79:            /* mov a, c */
+    OPCODE(0x79)          /* mov a, c */
       cycles = 5;
       A = C;
-      break;
+      NEXT;
 
-    case 0x7A:            /* mov a, d */
+    OPCODE(0x7A)          /* mov a, d */
       cycles = 5;
       A = D;
-      break;
+      NEXT;
 
-    case 0x7B:            /* mov a, e */
+    OPCODE(0x7B)          /* mov a, e */
       cycles = 5;
       A = E;
-      break;
+      NEXT;
 
-    case 0x7C:            /* mov a, h */
+    OPCODE(0x7C)          /* mov a, h */
       cycles = 5;
       A = H;
-      break;
+      NEXT;
 
-    case 0x7D:            /* mov a, l */
+    OPCODE(0x7D)          /* mov a, l */
       cycles = 5;
       A = L;
-      break;
+      NEXT;
 
-    case 0x7E:            /* mov a, m */
+    OPCODE(0x7E)          /* mov a, m */
       cycles = 7;
       A = RD_BYTE(HL);
-      break;
+      NEXT;
 
-    case 0x7F:            /* mov a, a */
+    OPCODE(0x7F)          /* mov a, a */
       cycles = 5;
-      break;
+      NEXT;
 
-    case 0x80:            /* add b */
+    OPCODE(0x80)          /* add b */
       cycles = 4;
       ADD(B);
-      break;
+      NEXT;
 
-    case 0x81:            /* add c */
+    OPCODE(0x81)          /* add c */
       cycles = 4;
       ADD(C);
-      break;
+      NEXT;
 
-    case 0x82:            /* add d */
+    OPCODE(0x82)          /* add d */
       cycles = 4;
       ADD(D);
-      break;
+      NEXT;
 
-    case 0x83:            /* add e */
+    OPCODE(0x83)          /* add e */
       cycles = 4;
       ADD(E);
-      break;
+      NEXT;
 
-    case 0x84:            /* add h */
+    OPCODE(0x84)          /* add h */
       cycles = 4;
       ADD(H);
-      break;
+      NEXT;
 
-    case 0x85:            /* add l */
+    OPCODE(0x85)          /* add l */
       cycles = 4;
       ADD(L);
-      break;
+      NEXT;
 
-    case 0x86:            /* add m */
+    OPCODE(0x86)          /* add m */
       cycles = 7;
       work8 = RD_BYTE(HL);
       ADD(work8);
-      break;
+      NEXT;
 
-    case 0x87:            /* add a */
+    OPCODE(0x87)          /* add a */
       cycles = 4;
       ADD(A);
-      break;
+      NEXT;
 
-    case 0x88:            /* adc b */
+    OPCODE(0x88)          /* adc b */
       cycles = 4;
       ADC(B);
-      break;
+      NEXT;
 
-    case 0x89:            /* adc c */
+    OPCODE(0x89)          /* adc c */
       cycles = 4;
       ADC(C);
-      break;
+      NEXT;
 
-    case 0x8A:            /* adc d */
+    OPCODE(0x8A)          /* adc d */
       cycles = 4;
       ADC(D);
-      break;
+      NEXT;
 
-    case 0x8B:            /* adc e */
+    OPCODE(0x8B)          /* adc e */
       cycles = 4;
       ADC(E);
-      break;
+      NEXT;
 
-    case 0x8C:            /* adc h */
+    OPCODE(0x8C)          /* adc h */
       cycles = 4;
       ADC(H);
-      break;
+      NEXT;
 
-    case 0x8D:            /* adc l */
+    OPCODE(0x8D)          /* adc l */
       cycles = 4;
       ADC(L);
-      break;
+      NEXT;
 
-    case 0x8E:            /* adc m */
+    OPCODE(0x8E)          /* adc m */
       cycles = 7;
       work8 = RD_BYTE(HL);
       ADC(work8);
-      break;
+      NEXT;
 
-    case 0x8F:            /* adc a */
+    OPCODE(0x8F)          /* adc a */
       cycles = 4;
       ADC(A);
-      break;
+      NEXT;
 
-    case 0x90:            /* sub b */
+    OPCODE(0x90)          /* sub b */
       cycles = 4;
       SUB(B);
-      break;
+      NEXT;
 
-    case 0x91:            /* sub c */
+    OPCODE(0x91)          /* sub c */
       cycles = 4;
       SUB(C);
-      break;
+      NEXT;
 
-    case 0x92:            /* sub d */
+    OPCODE(0x92)          /* sub d */
       cycles = 4;
       SUB(D);
-      break;
+      NEXT;
 
-    case 0x93:            /* sub e */
+    OPCODE(0x93)          /* sub e */
       cycles = 4;
       SUB(E);
-      break;
+      NEXT;
 
-    case 0x94:            /* sub h */
+    OPCODE(0x94)          /* sub h */
       cycles = 4;
       SUB(H);
-      break;
+      NEXT;
 
-    case 0x95:            /* sub l */
+    OPCODE(0x95)          /* sub l */
       cycles = 4;
       SUB(L);
-      break;
+      NEXT;
 
-    case 0x96:            /* sub m */
+    OPCODE(0x96)          /* sub m */
       cycles = 7;
       work8 = RD_BYTE(HL);
       SUB(work8);
-      break;
+      NEXT;
 
-    case 0x97:            /* sub a */
+    OPCODE(0x97)          /* sub a */
       cycles = 4;
       SUB(A);
-      break;
+      NEXT;
 
-    case 0x98:            /* sbb b */
+    OPCODE(0x98)          /* sbb b */
       cycles = 4;
       SBB(B);
-      break;
+      NEXT;
 
-    case 0x99:            /* sbb c */
+    OPCODE(0x99)          /* sbb c */
       cycles = 4;
       SBB(C);
-      break;
+      NEXT;
 
-    case 0x9A:            /* sbb d */
+    OPCODE(0x9A)          /* sbb d */
       cycles = 4;
       SBB(D);
-      break;
+      NEXT;
 
-    case 0x9B:            /* sbb e */
+    OPCODE(0x9B)          /* sbb e */
       cycles = 4;
       SBB(E);
-      break;
+      NEXT;
 
-    case 0x9C:            /* sbb h */
+    OPCODE(0x9C)          /* sbb h */
       cycles = 4;
       SBB(H);
-      break;
+      NEXT;
 
-    case 0x9D:            /* sbb l */
+    OPCODE(0x9D)          /* sbb l */
       cycles = 4;
       SBB(L);
-      break;
+      NEXT;
 
-    case 0x9E:            /* sbb m */
+    OPCODE(0x9E)          /* sbb m */
       cycles = 7;
       work8 = RD_BYTE(HL);
       SBB(work8);
-      break;
+      NEXT;
 
-    case 0x9F:            /* sbb a */
+    OPCODE(0x9F)          /* sbb a */
       cycles = 4;
       SBB(A);
-      break;
+      NEXT;
 
-    case 0xA0:            /* ana b */
+    OPCODE(0xA0)          /* ana b */
       cycles = 4;
       ANA(B);
-      break;
+      NEXT;
 
-    case 0xA1:            /* ana c */
+    OPCODE(0xA1)          /* ana c */
       cycles = 4;
       ANA(C);
-      break;
+      NEXT;
 
-    case 0xA2:            /* ana d */
+    OPCODE(0xA2)          /* ana d */
       cycles = 4;
       ANA(D);
-      break;
+      NEXT;
 
-    case 0xA3:            /* ana e */
+    OPCODE(0xA3)          /* ana e */
       cycles = 4;
       ANA(E);
-      break;
+      NEXT;
 
-    case 0xA4:            /* ana h */
+    OPCODE(0xA4)          /* ana h */
       cycles = 4;
       ANA(H);
-      break;
+      NEXT;
 
-    case 0xA5:            /* ana l */
+    OPCODE(0xA5)          /* ana l */
       cycles = 4;
       ANA(L);
-      break;
+      NEXT;
 
-    case 0xA6:            /* ana m */
+    OPCODE(0xA6)          /* ana m */
       cycles = 7;
       work8 = RD_BYTE(HL);
       ANA(work8);
-      break;
+      NEXT;
 
-    case 0xA7:            /* ana a */
+    OPCODE(0xA7)          /* ana a */
       cycles = 4;
       ANA(A);
-      break;
+      NEXT;
 
-    case 0xA8:            /* xra b */
+    OPCODE(0xA8)          /* xra b */
       cycles = 4;
       XRA(B);
-      break;
+      NEXT;
 
-    case 0xA9:            /* xra c */
+    OPCODE(0xA9)          /* xra c */
       cycles = 4;
       XRA(C);
-      break;
+      NEXT;
 
-    case 0xAA:            /* xra d */
+    OPCODE(0xAA)          /* xra d */
       cycles = 4;
       XRA(D);
-      break;
+      NEXT;
 
-    case 0xAB:            /* xra e */
+    OPCODE(0xAB)          /* xra e */
       cycles = 4;
       XRA(E);
-      break;
+      NEXT;
 
-    case 0xAC:            /* xra h */
+    OPCODE(0xAC)          /* xra h */
       cycles = 4;
       XRA(H);
-      break;
+      NEXT;
 
-    case 0xAD:            /* xra l */
+    OPCODE(0xAD)          /* xra l */
       cycles = 4;
       XRA(L);
-      break;
+      NEXT;
 
-    case 0xAE:            /* xra m */
+    OPCODE(0xAE)          /* xra m */
       cycles = 7;
       work8 = RD_BYTE(HL);
       XRA(work8);
-      break;
+      NEXT;
 
-    case 0xAF:            /* xra a */
+    OPCODE(0xAF)          /* xra a */
       cycles = 4;
       XRA(A);
-      break;
+      NEXT;
 
-    case 0xB0:            /* ora b */
+    OPCODE(0xB0)          /* ora b */
       cycles = 4;
       ORA(B);
-      break;
+      NEXT;
 
-    case 0xB1:            /* ora c */
+    OPCODE(0xB1)          /* ora c */
       cycles = 4;
       ORA(C);
-      break;
+      NEXT;
 
-    case 0xB2:            /* ora d */
+    OPCODE(0xB2)          /* ora d */
       cycles = 4;
       ORA(D);
-      break;
+      NEXT;
 
-    case 0xB3:            /* ora e */
+    OPCODE(0xB3)          /* ora e */
       cycles = 4;
       ORA(E);
-      break;
+      NEXT;
 
-    case 0xB4:            /* ora h */
+    OPCODE(0xB4)          /* ora h */
       cycles = 4;
       ORA(H);
-      break;
+      NEXT;
 
-    case 0xB5:            /* ora l */
+    OPCODE(0xB5)          /* ora l */
       cycles = 4;
       ORA(L);
-      break;
+      NEXT;
 
-    case 0xB6:            /* ora m */
+    OPCODE(0xB6)          /* ora m */
       cycles = 7;
       work8 = RD_BYTE(HL);
       ORA(work8);
-      break;
+      NEXT;
 
-    case 0xB7:            /* ora a */
+    OPCODE(0xB7)          /* ora a */
       cycles = 4;
       ORA(A);
-      break;
+      NEXT;
 
-    case 0xB8:            /* cmp b */
+    OPCODE(0xB8)          /* cmp b */
       cycles = 4;
       CMP(B);
-      break;
+      NEXT;
 
-    case 0xB9:            /* cmp c */
+    OPCODE(0xB9)          /* cmp c */
       cycles = 4;
       CMP(C);
-      break;
+      NEXT;
 
-    case 0xBA:            /* cmp d */
+    OPCODE(0xBA)          /* cmp d */
       cycles = 4;
       CMP(D);
-      break;
+      NEXT;
 
-    case 0xBB:            /* cmp e */
+    OPCODE(0xBB)          /* cmp e */
       cycles = 4;
       CMP(E);
-      break;
+      NEXT;
 
-    case 0xBC:            /* cmp h */
+    OPCODE(0xBC)          /* cmp h */
       cycles = 4;
       CMP(H);
-      break;
+      NEXT;
 
-    case 0xBD:            /* cmp l */
+    OPCODE(0xBD)          /* cmp l */
       cycles = 4;
       CMP(L);
-      break;
+      NEXT;
 
-    case 0xBE:            /* cmp m */
+    OPCODE(0xBE)          /* cmp m */
       cycles = 7;
       work8 = RD_BYTE(HL);
       CMP(work8);
-      break;
+      NEXT;
 
-    case 0xBF:            /* cmp a */
+    OPCODE(0xBF)          /* cmp a */
       cycles = 4;
       CMP(A);
-      break;
+      NEXT;
 
-    case 0xC0:            /* rnz */
+    OPCODE(0xC0)          /* rnz */
       cycles = 5;
       if (!TST(Z_FLAG)) {
         cycles = 11;
         POP(PC);
       }
-      break;
+      NEXT;
 
-    case 0xC1:            /* pop b */
+    OPCODE(0xC1)          /* pop b */
       cycles = 11;
       POP(BC);
-      break;
+      NEXT;
 
-    case 0xC2:            /* jnz addr */
+    OPCODE(0xC2)          /* jnz addr */
       cycles = 10;
       if (!TST(Z_FLAG)) {
-        PC = RD_WORD(PC);
+        PC = IMM16();
       }
       else {
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xC3:            /* jmp addr */
-    case 0xCB:            /* jmp addr, undocumented */
+    OPCODE(0xC3)          /* jmp addr */
+    OPCODE(0xCB)          /* jmp addr, undocumented */
       cycles = 10;
-      PC = RD_WORD(PC);
-      break;
+      PC = IMM16();
+      TRAP();
+      NEXT;
 
-    case 0xC4:            /* cnz addr */
+    OPCODE(0xC4)          /* cnz addr */
       if (!TST(Z_FLAG)) {
         cycles = 17;
         CALL;
@@ -1287,48 +1539,48 @@ int I8080::execute(int opcode) {
         cycles = 11;
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xC5:            /* push b */
+    OPCODE(0xC5)          /* push b */
       cycles = 11;
       PUSH(BC);
-      break;
+      NEXT;
 
-    case 0xC6:            /* adi data8 */
+    OPCODE(0xC6)          /* adi data8 */
       cycles = 7;
-      work8 = RD_BYTE(PC++);
+      work8 = IMM8();
       ADD(work8);
-      break;
+      NEXT;
 
-    case 0xC7:            /* rst 0 */
+    OPCODE(0xC7)          /* rst 0 */
       cycles = 11;
       RST(0x0000);
-      break;
+      NEXT;
 
-    case 0xC8:            /* rz */
+    OPCODE(0xC8)          /* rz */
       cycles = 5;
       if (TST(Z_FLAG)) {
         cycles = 11;
         POP(PC);
       }
-      break;
+      NEXT;
 
-    case 0xC9:            /* ret */
-    case 0xD9:            /* ret, undocumented */
+    OPCODE(0xC9)          /* ret */
+    OPCODE(0xD9)          /* ret, undocumented */
       cycles = 10;
       POP(PC);
-      break;
+      NEXT;
 
-    case 0xCA:            /* jz addr */
+    OPCODE(0xCA)          /* jz addr */
       cycles = 10;
       if (TST(Z_FLAG)) {
-        PC = RD_WORD(PC);
+        PC = IMM16();
       } else {
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xCC:            /* cz addr */
+    OPCODE(0xCC)          /* cz addr */
       if (TST(Z_FLAG)) {
         cycles = 17;
         CALL;
@@ -1336,55 +1588,56 @@ int I8080::execute(int opcode) {
         cycles = 11;
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xCD:            /* call addr */
-    case 0xDD:            /* call, undocumented */
-    case 0xED:
-    case 0xFD:
+    OPCODE(0xCD)          /* call addr */
+    OPCODE(0xDD)          /* call, undocumented */
+    OPCODE(0xED)
+    OPCODE(0xFD)
       cycles = 17;
       CALL;
-      break;
+      NEXT;
 
-    case 0xCE:            /* aci data8 */
+    OPCODE(0xCE)          /* aci data8 */
       cycles = 7;
-      work8 = RD_BYTE(PC++);
+      work8 = IMM8();
       ADC(work8);
-      break;
+      NEXT;
 
-    case 0xCF:            /* rst 1 */
+    OPCODE(0xCF)          /* rst 1 */
       cycles = 11;
       RST(0x0008);
-      break;
+      NEXT;
 
-    case 0xD0:            /* rnc */
+    OPCODE(0xD0)          /* rnc */
       cycles = 5;
       if (!TST(C_FLAG)) {
         cycles = 11;
         POP(PC);
       }
-      break;
+      NEXT;
 
-    case 0xD1:            /* pop d */
+    OPCODE(0xD1)          /* pop d */
       cycles = 11;
       POP(DE);
-      break;
+      NEXT;
 
-    case 0xD2:            /* jnc addr */
+    OPCODE(0xD2)          /* jnc addr */
       cycles = 10;
       if (!TST(C_FLAG)) {
-        PC = RD_WORD(PC);
+        PC = IMM16();
       } else {
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xD3:            /* out port8 */
+    OPCODE(0xD3)          /* out port8 */
       cycles = 10;
-      io_output(RD_BYTE(PC++), A);
-      break;
+      io_output(IMM8(), A);
+      BREAK_RUN();
+      NEXT;
 
-    case 0xD4:            /* cnc addr */
+    OPCODE(0xD4)          /* cnc addr */
       if (!TST(C_FLAG)) {
         cycles = 17;
         CALL;
@@ -1392,47 +1645,48 @@ int I8080::execute(int opcode) {
         cycles = 11;
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xD5:            /* push d */
+    OPCODE(0xD5)          /* push d */
       cycles = 11;
       PUSH(DE);
-      break;
+      NEXT;
 
-    case 0xD6:            /* sui data8 */
+    OPCODE(0xD6)          /* sui data8 */
       cycles = 7;
-      work8 = RD_BYTE(PC++);
+      work8 = IMM8();
       SUB(work8);
-      break;
+      NEXT;
 
-    case 0xD7:            /* rst 2 */
+    OPCODE(0xD7)          /* rst 2 */
       cycles = 11;
       RST(0x0010);
-      break;
+      NEXT;
 
-    case 0xD8:            /* rc */
+    OPCODE(0xD8)          /* rc */
       cycles = 5;
       if (TST(C_FLAG)) {
         cycles = 11;
         POP(PC);
       }
-      break;
+      NEXT;
 
-    case 0xDA:            /* jc addr */
+    OPCODE(0xDA)          /* jc addr */
       cycles = 10;
       if (TST(C_FLAG)) {
-        PC = RD_WORD(PC);
+        PC = IMM16();
       } else {
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xDB:            /* in port8 */
+    OPCODE(0xDB)          /* in port8 */
       cycles = 10;
-      A = io_input(RD_BYTE(PC++));
-      break;
+      A = io_input(IMM8());
+      BREAK_RUN();
+      NEXT;
 
-    case 0xDC:            /* cc addr */
+    OPCODE(0xDC)          /* cc addr */
       if (TST(C_FLAG)) {
         cycles = 17;
         CALL;
@@ -1440,50 +1694,50 @@ int I8080::execute(int opcode) {
         cycles = 11;
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xDE:            /* sbi data8 */
+    OPCODE(0xDE)          /* sbi data8 */
       cycles = 7;
-      work8 = RD_BYTE(PC++);
+      work8 = IMM8();
       SBB(work8);
-      break;
+      NEXT;
 
-    case 0xDF:            /* rst 3 */
+    OPCODE(0xDF)          /* rst 3 */
       cycles = 11;
       RST(0x0018);
-      break;
+      NEXT;
 
-    case 0xE0:            /* rpo */
+    OPCODE(0xE0)          /* rpo */
       cycles = 5;
       if (!TST(P_FLAG)) {
         cycles = 11;
         POP(PC);
       }
-      break;
+      NEXT;
 
-    case 0xE1:            /* pop h */
+    OPCODE(0xE1)          /* pop h */
       cycles = 11;
       POP(HL);
-      break;
+      NEXT;
 
-    case 0xE2:            /* jpo addr */
+    OPCODE(0xE2)          /* jpo addr */
       cycles = 10;
       if (!TST(P_FLAG)) {
-        PC = RD_WORD(PC);
+        PC = IMM16();
       }
       else {
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xE3:            /* xthl */
+    OPCODE(0xE3)          /* xthl */
       cycles = 18;
       work16 = RD_WORD(SP);
       WR_WORD(SP, HL);
       HL = work16;
-      break;
+      NEXT;
 
-    case 0xE4:            /* cpo addr */
+    OPCODE(0xE4)          /* cpo addr */
       if (!TST(P_FLAG)) {
         cycles = 17;
         CALL;
@@ -1491,54 +1745,54 @@ int I8080::execute(int opcode) {
         cycles = 11;
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xE5:            /* push h */
+    OPCODE(0xE5)          /* push h */
       cycles = 11;
       PUSH(HL);
-      break;
+      NEXT;
 
-    case 0xE6:            /* ani data8 */
+    OPCODE(0xE6)          /* ani data8 */
       cycles = 7;
-      work8 = RD_BYTE(PC++);
+      work8 = IMM8();
       ANA(work8);
-      break;
+      NEXT;
 
-    case 0xE7:            /* rst 4 */
+    OPCODE(0xE7)          /* rst 4 */
       cycles = 11;
       RST(0x0020);
-      break;
+      NEXT;
 
-    case 0xE8:            /* rpe */
+    OPCODE(0xE8)          /* rpe */
       cycles = 5;
       if (TST(P_FLAG)) {
         cycles = 11;
         POP(PC);
       }
-      break;
+      NEXT;
 
-    case 0xE9:            /* pchl */
+    OPCODE(0xE9)          /* pchl */
       cycles = 5;
       PC = HL;
-      break;
+      NEXT;
 
-    case 0xEA:            /* jpe addr */
+    OPCODE(0xEA)          /* jpe addr */
       cycles = 10;
       if (TST(P_FLAG)) {
-        PC = RD_WORD(PC);
+        PC = IMM16();
       } else {
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xEB:            /* xchg */
+    OPCODE(0xEB)          /* xchg */
       cycles = 4;
       work16 = DE;
       DE = HL;
       HL = work16;
-      break;
+      NEXT;
 
-    case 0xEC:            /* cpe addr */
+    OPCODE(0xEC)          /* cpe addr */
       if (TST(P_FLAG)) {
         cycles = 17;
         CALL;
@@ -1546,49 +1800,49 @@ int I8080::execute(int opcode) {
         cycles = 11;
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xEE:            /* xri data8 */
+    OPCODE(0xEE)          /* xri data8 */
       cycles = 7;
-      work8 = RD_BYTE(PC++);
+      work8 = IMM8();
       XRA(work8);
-      break;
+      NEXT;
 
-    case 0xEF:            /* rst 5 */
+    OPCODE(0xEF)          /* rst 5 */
       cycles = 11;
       RST(0x0028);
-      break;
+      NEXT;
 
-    case 0xF0:            /* rp */
+    OPCODE(0xF0)          /* rp */
       cycles = 5;
       if (!TST(S_FLAG)) {
         cycles = 11;
         POP(PC);
       }
-      break;
+      NEXT;
 
-    case 0xF1:            /* pop psw */
+    OPCODE(0xF1)          /* pop psw */
       cycles = 10;
       POP(AF);
       retrieve_flags();
-      break;
+      NEXT;
 
-    case 0xF2:            /* jp addr */
+    OPCODE(0xF2)          /* jp addr */
       cycles = 10;
       if (!TST(S_FLAG)) {
-        PC = RD_WORD(PC);
+        PC = IMM16();
       } else {
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xF3:            /* di */
+    OPCODE(0xF3)          /* di */
       cycles = 4;
       IFF = 0;
       iff(IFF);
-      break;
+      NEXT;
 
-    case 0xF4:            /* cp addr */
+    OPCODE(0xF4)          /* cp addr */
       if (!TST(S_FLAG)) {
         cycles = 17;
         CALL;
@@ -1596,54 +1850,54 @@ int I8080::execute(int opcode) {
         cycles = 11;
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xF5:            /* push psw */
+    OPCODE(0xF5)          /* push psw */
       cycles = 11;
       store_flags();
       PUSH(AF);
-      break;
+      NEXT;
 
-    case 0xF6:            /* ori data8 */
+    OPCODE(0xF6)          /* ori data8 */
       cycles = 7;
-      work8 = RD_BYTE(PC++);
+      work8 = IMM8();
       ORA(work8);
-      break;
+      NEXT;
 
-    case 0xF7:            /* rst 6 */
+    OPCODE(0xF7)          /* rst 6 */
       cycles = 11;
       RST(0x0030);
-      break;
+      NEXT;
 
-    case 0xF8:            /* rm */
+    OPCODE(0xF8)          /* rm */
       cycles = 5;
       if (TST(S_FLAG)) {
         cycles = 11;
         POP(PC);
       }
-      break;
+      NEXT;
 
-    case 0xF9:            /* sphl */
+    OPCODE(0xF9)          /* sphl */
       cycles = 5;
       SP = HL;
-      break;
+      NEXT;
 
-    case 0xFA:            /* jm addr */
+    OPCODE(0xFA)          /* jm addr */
       cycles = 10;
       if (TST(S_FLAG)) {
-        PC = RD_WORD(PC);
+        PC = IMM16();
       } else {
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xFB:            /* ei */
+    OPCODE(0xFB)          /* ei */
       cycles = 4;
       IFF = 1;
       iff(IFF);
-      break;
+      NEXT;
 
-    case 0xFC:            /* cm addr */
+    OPCODE(0xFC)          /* cm addr */
       if (TST(S_FLAG)) {
         cycles = 17;
         CALL;
@@ -1651,30 +1905,156 @@ int I8080::execute(int opcode) {
         cycles = 11;
         PC += 2;
       }
-      break;
+      NEXT;
 
-    case 0xFE:            /* cpi data8 */
+    OPCODE(0xFE)          /* cpi data8 */
       cycles = 7;
-      work8 = RD_BYTE(PC++);
+      work8 = IMM8();
       CMP(work8);
-      break;
+      NEXT;
 
-    case 0xFF:            /* rst 7 */
+    OPCODE(0xFF)          /* rst 7 */
       cycles = 11;
       RST(0x0038);
-      break;
+      NEXT;
 
     default:
       cycles = -1;  /* Shouldn't be really here. */
       break;
   }
+#ifdef CPU_THREADED
+  return total;
+#else
   return cycles;
+#endif
 }
 
 int I8080::instruction(void) {
-  return execute(RD_BYTE(PC++));
+#ifdef CPU_THREADED
+  // Any budget will do, every instruction takes at least 4 cycles
+  return execute(1);
+#else
+  return execute(RD_CODE(PC++));
+#endif
 }
 
+/*
+  Run instructions until the cycles budget is spent, the CPU is
+  stopped, halted or an I/O instruction has been executed
+*/
+int I8080::run(int budget) {
+  int total = 0;
+#ifdef CPU_THREADED
+  if (state)
+    total = execute(budget);
+#else
+  trapped = false;
+  while (state and not trapped and total < budget)
+    total += execute(RD_CODE(PC++));
+#endif
+  elapsed += total;
+  return total;
+}
+
+#ifdef CPU_BLOCKS
+/*
+  Find the translated block starting at the address, translate it if needed
+*/
+block_t* I8080::lookup(uns16 addr) {
+  block_t *blk = &blocks[(addr ^ (addr >> 6)) & (CPU_BLOCKS - 1)];
+  if (blk->len == 0 or blk->pc != addr)
+    translate(blk, addr);
+  return blk;
+}
+
+/*
+  Decode the straight-line code starting at the address into micro-ops
+*/
+void I8080::translate(block_t *blk, uns16 addr) {
+  uop_t *uop = blk->ops;
+  uns8 info, len;
+  blk->pc   = addr;
+  blk->size = 0;
+  blk->len  = 0;
+  do {
+    // Opcode and immediate operand
+    uop->op = RD_CODE(addr);
+    info = op_info[uop->op];
+    len  = info & OP_LEN;
+    if (len == 2)
+      uop->w = RD_CODE((uns16)(addr + 1));
+    else if (len == 3)
+      uop->w = RD_CODE16((uns16)(addr + 1));
+    // Mark the code lines
+    for (uns8 i = 0; i < len; i++)
+      SET_CODE((uns16)(addr + i));
+    addr += len;
+    blk->size += len;
+    blk->len++;
+    uop++;
+  } while (not (info & OP_END) and blk->len < CPU_BLOCK_OPS);
+}
+#endif
+
+/*
+  Drop the translated blocks overlapping the memory range
+*/
+void I8080::invalidate(int addr, int len) {
+#ifdef CPU_BLOCKS
+  block_t *blk;
+  uns16 line;
+  bool keep;
+  if (len >= 0x10000) {
+    // Drop everything
+    for (blk = blocks; blk < blocks + CPU_BLOCKS; blk++) {
+      blk->len  = 0;
+      blk->next = blk;
+    }
+    memset(codeMap, 0, sizeof(codeMap));
+    return;
+  }
+  // Drop the overlapping blocks
+  for (blk = blocks; blk < blocks + CPU_BLOCKS; blk++)
+    if (blk->len and OVERLAP(blk, addr, len))
+      blk->len = 0;
+  // Unmark the lines not holding translated code anymore
+  line = addr & ~0x1F;
+  for (int n = ((addr & 0x1F) + len + 0x1F) >> 5; n > 0; n--, line += 0x20) {
+    keep = false;
+    for (blk = blocks; blk < blocks + CPU_BLOCKS; blk++)
+      if (blk->len and OVERLAP(blk, line, 0x20)) {
+        keep = true;
+        break;
+      }
+    if (not keep)
+      CLR_CODE(line);
+  }
+#endif
+}
+
+#ifdef CPU_FAST_TRAP
+/*
+  Run the "IN/OUT port; RET" stub at PC, if it is still in place,
+  including the return, unless the handler jumped somewhere else
+*/
+bool I8080::trap(void) {
+  uns16 addr = PC;
+  uns8  op = RD_BYTE(addr);
+  if ((op != 0xDB and op != 0xD3) or RD_BYTE((uns16)(addr + 2)) != 0xC9)
+    return false;
+  // Past the IN/OUT instruction
+  PC += 2;
+  if (op == 0xDB)
+    A = io_input(RD_BYTE((uns16)(addr + 1)));
+  else
+    io_output(RD_BYTE((uns16)(addr + 1)), A);
+  // Return to the caller
+  if (PC == (uns16)(addr + 2))
+    RET();
+  return true;
+}
+#endif
+
 void I8080::jump(int addr) {
   PC = addr & 0xffff;
 }
@@ -1683,6 +2063,13 @@ int I8080::pc(void) {
   return PC;
 }
 
+/*
+  Cycles run so far, updated when each run ends
+*/
+uns32 I8080::cycles(void) {
+  return elapsed;
+}
+
 int I8080::regBC(void) {
   return BC;
 }
@@ -1691,7 +2078,7 @@ int I8080::regDE(void) {
   return DE;
 }
 
-int i8080_regHL(void) {
+int I8080::regHL(void) {
   return HL;
 }
 
@@ -37,6 +37,15 @@
 #define I8080_H
 
 #include <Arduino.h>
+#include "config.h"
+#include "global.h"
+#ifdef SPI_RAM
+#include "spiram.h"
+typedef SPIRAM RAM;
+#else
+#include "mcuram.h"
+typedef MCURAM RAM;
+#endif
 
 
 typedef unsigned char           uns8;
@@ -53,36 +62,49 @@ typedef union {
   uns16 w;
 } reg_pair;
 
+#ifdef CPU_BLOCKS
+#ifndef CPU_THREADED
+#error "The translation cache (CPU_BLOCKS) needs the threaded engine (CPU_THREADED)"
+#endif
+
 typedef struct {
-  uns8 carry_flag;
-  uns8 unused1;
-  uns8 parity_flag;
-  uns8 unused3;
-  uns8 half_carry_flag;
-  uns8 unused5;
-  uns8 zero_flag;
-  uns8 sign_flag;
-} flag_reg;
+  uns8  op;               // Opcode
+  uns16 w;                // Immediate operand
+} uop_t;
+
+typedef struct block_t {
+  uns16 pc;               // Address of the first instruction
+  uns8  size;             // Code size (bytes)
+  uns8  len;              // Number of micro-ops, 0 if not valid
+  struct block_t *next;   // Last successor block
+  uop_t ops[CPU_BLOCK_OPS];
+} block_t;
+#endif
 
 struct registers {
-  flag_reg f;
   reg_pair af, bc, de, hl;
   reg_pair sp, pc;
   uns16 iff;
   uns16 last_pc;
+#ifdef CPU_LAZY_FLAGS
+  uns8  lazy;             // Last operation affecting the flags
+  uns8  lazy_a, lazy_v;   // Its operands
+  uns8  lazy_r;           // Its result
+#endif
 };
 
-static struct registers regs;
-
 
 class I8080 {
   public:
-    I8080();
+    I8080(RAM *ram);
     ~I8080();
     void init(void);
     int  instruction(void);
+    int  run(int budget);
+    void invalidate(int addr, int len);
     void jump(int addr);
     int  pc(void);
+    uns32 cycles(void);
 
     int  regBC(void);
     int  regDE(void);
@@ -108,10 +130,6 @@ class I8080 {
     void regH(uns8 value);
     void regL(uns8 value);
 
-    int  read_word(int addr);
-    void write_word(int addr, int word);
-    int  read_byte(int addr);
-    void write_byte(int addr, int byte);
     int  io_input(int port);
     void io_output(int port, int value);
     void iff(int on);
@@ -123,16 +141,41 @@ class I8080 {
 
 
   private:
+    RAM   *ram;
+    struct registers regs;
+
     void store_flags(void);
     void retrieve_flags(void);
+#ifdef CPU_LAZY_FLAGS
+    void eval_flags(void);
+#endif
+#ifdef CPU_FAST_TRAP
+    bool trap(void);
+#endif
+#ifdef CPU_THREADED
+    int  execute(int budget);
+#else
     int  execute(int opcode);
+#endif
 
+    uns32 elapsed = 0;        // Cycles run so far
     uns32 work32;
     uns16 work16;
     uns8  work8;
     int   index;
     uns8  carry, add;
     int   opcode;
+#ifndef CPU_THREADED
+    bool  trapped;
+#endif
+
+#ifdef CPU_BLOCKS
+    block_t*  lookup(uns16 addr);
+    void      translate(block_t *blk, uns16 addr);
+
+    block_t   blocks[CPU_BLOCKS];   // Translated blocks
+    uns8      codeMap[256];         // Lines holding translated code
+#endif
 
 };
 
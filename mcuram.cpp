@@ -20,11 +20,19 @@
 #include "mcuram.h"
 
 MCURAM::MCURAM() {
-  // Allocate RAM in DRAM
+  // Start with all pages unmapped
+  memset(noPage, 0xFF, sizeof(noPage));
+  for (uint16_t page = 0; page < 256; page++)
+    map(page, NULL);
+  // Allocate RAM in DRAM and map it
 #ifdef MMU_IRAM_HEAP
   buf = (uint8_t*)malloc(DMEMK * 1024);
+  for (uint16_t page = 0; page < DMEMK * 4; page++)
+    map(page, buf + page * 256);
 #else
   buf = (uint8_t*)malloc(MEMK * 1024);
+  for (uint16_t page = 0; page < MEMK * 4; page++)
+    map(page, buf + page * 256);
 #endif
 }
 
@@ -41,9 +49,18 @@ void MCURAM::init() {
     HeapSelectIram ephemeral;
     ibuf = (uint8_t*)malloc(IMEMK * 1024);
   }
+  // Map it after DRAM
+  for (uint16_t page = 0; page < IMEMK * 4; page++)
+    map(DMEMK * 4 + page, ibuf + page * 256);
 #endif
 }
 
+// Map a page to a buffer, read-only or read-write, or unmap it (NULL)
+void MCURAM::map(uint8_t page, uint8_t *data, bool readOnly) {
+  rdPage[page] = data ? data : noPage;
+  wrPage[page] = (data and not readOnly) ? data : sinkPage;
+}
+
 void MCURAM::clear() {
 }
 
@@ -58,84 +75,45 @@ void MCURAM::flush() {
 void MCURAM::flush(uint16_t addr) {
 }
 
-uint8_t MCURAM::getByte(uint16_t addr) {
-  // Return one byte from the correct buffer
-#ifdef MMU_IRAM_HEAP
-  if (addr < DMEM)
-    return buf[addr];
-  else if (addr <= LASTBYTE)
-    return ibuf[addr - DMEM];
-  else
-    return 0xFF;
-#else
-  return addr <= LASTBYTE ? buf[addr] : 0xFF;
-#endif
-}
-
-void MCURAM::setByte(uint16_t addr, uint8_t data) {
-  // Set one byte into the correct buffer
-#ifdef MMU_IRAM_HEAP
-  if (addr < DMEM)
-    buf[addr] = data;
-  else if (addr <= LASTBYTE)
-    ibuf[addr - DMEM] = data;
-#else
-  if (addr <= LASTBYTE)
-    buf[addr] = data;
-#endif
-}
-
-uint16_t MCURAM::getWord(uint16_t addr) {
-  // Return one word from the correct buffer
-#ifdef MMU_IRAM_HEAP
-  if (addr < DMEM - 1)
-    return buf[addr] + buf[addr + 1] * 0x0100;
-  else if (addr == DMEM)
-    return buf[DMEM] + ibuf[0] * 0x0100;
-  else if (addr < LASTBYTE) {
-    uint16_t idx = addr - DMEM;
-    return ibuf[idx] + ibuf[idx + 1] * 0x0100;
+// Copy a block out of RAM, one page at a time
+void MCURAM::read(uint16_t addr, uint8_t *data, uint16_t len) {
+  uint16_t n;
+  while (len) {
+    n = 256 - MEM_OFS(addr);
+    if (n > len)
+      n = len;
+    memcpy(data, rdPage[MEM_PAGE(addr)] + MEM_OFS(addr), n);
+    data += n;
+    addr += n;
+    len  -= n;
   }
-  else
-    return 0xFFFF;
-#else
-  return addr < LASTBYTE ? (buf[addr] + buf[addr + 1] * 0x0100) : 0xFFFF;
-#endif
 }
 
-void MCURAM::setWord(uint16_t addr, uint16_t data) {
-  // Set one word into the correct buffer
-#ifdef MMU_IRAM_HEAP
-  if (addr < DMEM - 1) {
-    buf[addr]     = lowByte(data);
-    buf[addr + 1] = highByte(data);
-
-  }
-  else if (addr == DMEM) {
-    buf[DMEM]     = lowByte(data);
-    ibuf[0]       = highByte(data);
-  }
-  else if (addr < LASTBYTE) {
-    uint16_t idx = addr - DMEM;
-    ibuf[addr - DMEM]     = lowByte(data);
-    ibuf[addr - DMEM + 1] = highByte(data);
-  }
-#else
-  if (addr < LASTBYTE) {
-    buf[addr]     = lowByte(data);
-    buf[addr + 1] = highByte(data);
+// Copy a block into RAM, one page at a time
+void MCURAM::write(uint16_t addr, uint8_t *data, uint16_t len) {
+  uint16_t n;
+  while (len) {
+    n = 256 - MEM_OFS(addr);
+    if (n > len)
+      n = len;
+    memcpy(wrPage[MEM_PAGE(addr)] + MEM_OFS(addr), data, n);
+    data += n;
+    addr += n;
+    len  -= n;
   }
-#endif
 }
 
-void MCURAM::read(uint16_t addr, uint8_t *data, uint16_t len) {
-  for (uint16_t i = 0; i < len; i++)
-    data[i] = getByte(addr++);
-}
-
-void MCURAM::write(uint16_t addr, uint8_t *data, uint16_t len) {
-  for (uint16_t i = 0; i < len; i++)
-    setByte(addr++, data[i]);
+// Direct access to a block, if it is contiguous, writable
+// and does not wrap around, NULL otherwise
+uint8_t* MCURAM::span(uint16_t addr, uint16_t len) {
+  uint8_t *data = rdPage[MEM_PAGE(addr)] + MEM_OFS(addr);
+  if (len == 0 or (uint32_t)addr + len > 0x10000UL)
+    return NULL;
+  for (uint16_t page = MEM_PAGE(addr); page <= MEM_PAGE(addr + len - 1); page++)
+    if (rdPage[page] != wrPage[page] or
+        rdPage[page] != data - MEM_OFS(addr) + (page - MEM_PAGE(addr)) * 256)
+      return NULL;
+  return data;
 }
 
 void MCURAM::hexdump(uint16_t start, uint16_t stop, char* comment) {
@@ -27,6 +27,10 @@
 #include "config.h"
 #include "global.h"
 
+// Page and offset of a memory address
+#define MEM_PAGE(addr)  ((addr) >> 8)
+#define MEM_OFS(addr)   ((addr) & 0xFF)
+
 class MCURAM {
   public:
     MCURAM();
@@ -36,18 +40,52 @@ class MCURAM {
     void      reset();
     void      flush();
     void      flush(uint16_t addr);
+    void      map(uint8_t page, uint8_t *data, bool readOnly = false);
     uint8_t   getByte(uint16_t addr);
     void      setByte(uint16_t addr, uint8_t data);
+    uint8_t   fetch(uint16_t addr);
     uint16_t  getWord(uint16_t addr);
     void      setWord(uint16_t addr, uint16_t data);
     void      read(uint16_t addr, uint8_t *data, uint16_t len);
     void      write(uint16_t addr, uint8_t *data, uint16_t len);
+    uint8_t*  span(uint16_t addr, uint16_t len);
     void      hexdump(uint16_t start = 0x0000, uint16_t stop = LASTBYTE, char* comment = "");
 
   private:
     // Buffer
     uint8_t*  buf;    // Primary buffer in DRAM
     uint8_t*  ibuf;   // Secondary buffer in IRAM (optional)
+
+    // Page tables, 256 pages of 256 bytes each
+    uint8_t*  rdPage[256];
+    uint8_t*  wrPage[256];
+    uint8_t   noPage[256];    // Read from unmapped pages
+    uint8_t   sinkPage[256];  // Written to read-only and unmapped pages
 };
 
+// The memory accessors are inlined into the CPU core
+
+inline uint8_t MCURAM::getByte(uint16_t addr) {
+  return rdPage[MEM_PAGE(addr)][MEM_OFS(addr)];
+}
+
+inline void MCURAM::setByte(uint16_t addr, uint8_t data) {
+  wrPage[MEM_PAGE(addr)][MEM_OFS(addr)] = data;
+}
+
+// Instruction fetch, the same as any other read
+inline uint8_t MCURAM::fetch(uint16_t addr) {
+  return getByte(addr);
+}
+
+// The two bytes of a word may be in different pages
+inline uint16_t MCURAM::getWord(uint16_t addr) {
+  return getByte(addr) + getByte(addr + 1) * 0x0100;
+}
+
+inline void MCURAM::setWord(uint16_t addr, uint16_t data) {
+  setByte(addr,     lowByte(data));
+  setByte(addr + 1, highByte(data));
+}
+
 #endif /* MCURAM_H */
@@ -19,7 +19,7 @@
 
 #include "spiram.h"
 
-SPIRAM::SPIRAM(int CS, uint16_t bufSize): cs(CS), bufSize(bufSize) {
+SPIRAM::SPIRAM(int CS): cs(CS) {
   // Initialize the RAM chip
   pinMode(cs, OUTPUT);
   digitalWrite(cs, HIGH);
@@ -28,12 +28,11 @@ SPIRAM::SPIRAM(int CS, uint16_t bufSize): cs(CS), bufSize(bufSize) {
   delay(50);
   digitalWrite(cs, HIGH);
 
-  // Allocate one more byte (to make room for 16-bit operations)
-  buf = (uint8_t*)malloc(bufSize + 1);
+  // Start with an empty cache
+  invalidate();
 }
 
 SPIRAM::~SPIRAM() {
-  free(buf);
 }
 
 void SPIRAM::init() {
@@ -46,20 +45,23 @@ void SPIRAM::init() {
 void SPIRAM::clear() {
   // Begin SPI transfer
   begin();
-  // Command
-  SPI.transfer(CMD_WRITE);
-  // Address
-  SPI.transfer(0x00);
-  SPI.transfer(0x00);
-  SPI.transfer(0x00);
-  // Data
+  // Command and address
+  command(CMD_WRITE, 0x0000);
+  // Data, one page at a time
   for (int x = 0x00; x <= 0xFF; ++x) {
-    for (int y = 0x00; y <= 0xFF; ++y)
-      SPI.transfer(0x00);
+#ifdef ESP8266
+    uint8_t zero = 0x00;
+    SPI.writePattern(&zero, 1, 256);
+#else
+    uint8_t page[256] = {0};
+    SPI.transfer(page, 256);
+#endif
     yield();
   }
   // End SPI transfer
   end();
+  // Drop the cached lines
+  invalidate();
 }
 
 void SPIRAM::reset() {
@@ -71,107 +73,104 @@ void SPIRAM::reset() {
   end();
 }
 
-// Check if the address is contained in buffer
-bool SPIRAM::inBuffer(uint16_t addr) {
-  return (addr >= bufStart and addr <= bufEnd);
+// Empty the cache, without writing back the dirty lines
+void SPIRAM::invalidate() {
+  for (uint8_t set = 0; set < RAM_SETS; set++) {
+    for (uint8_t way = 0; way < RAM_WAYS; way++) {
+      tags[set][way] = RAM_NOLINE;
+      ages[set][way] = way;
+    }
+    mru[set]   = 0;
+    dirty[set] = 0;
+  }
+  iStart = RAM_NOFETCH;
 }
 
-// Flush the buffer, if dirty, and reset it
+// Write back the dirty lines and empty the cache
 void SPIRAM::flush() {
-  // Write back the buffer into RAM
-  wrBuffer();
-  // Reset the start and end addresses
-  bufStart = LASTBYTE;
-  bufEnd   = LASTBYTE;
+  for (uint8_t set = 0; set < RAM_SETS; set++)
+    for (uint8_t way = 0; way < RAM_WAYS; way++)
+      wrLine(set, way);
+  invalidate();
 }
 
-// Flush the buffer, if dirty and the address is contained, and reset it
+// Write back the line holding the address, if dirty, and drop it
 void SPIRAM::flush(uint16_t addr) {
-  // Check if the address is contained in buffer
-  if (inBuffer(addr))
-    // Need to flush
-    flush();
-}
-
-void SPIRAM::chBuffer(uint16_t addr) {
-  // Check if the address is contained in buffer
-  if (inBuffer(addr))
-    return;
-  // Write back the buffer into RAM
-  wrBuffer();
-  // Set new start address
-  if (addr > (LASTBYTE - bufSize))
-    bufStart = LASTBYTE - bufSize + 1;
-  else
-    bufStart = addr;
-  // End address
-  bufEnd = bufStart + bufSize - 1;
-  // Fetch the buffer from RAM
-  rdBuffer();
-}
-
-// Read a buffer from RAM and mark it clean
-void SPIRAM::rdBuffer() {
-  // Read RAM data into buffer
-  read(bufStart, buf, bufSize + 1);
-  // Make it clean
-  bufDirty = false;
-}
-
-// Write a buffer to RAM, if dirty, and mark it clean
-void SPIRAM::wrBuffer() {
-  if (bufDirty) {
-    // Write buffer data into RAM
-    write(bufStart, buf, bufSize + 1);
-    // Make it clean
-    bufDirty = false;
+  uint8_t set = RAM_SET(addr);
+  uint8_t way = findLine(RAM_TAG(addr));
+  if (way < RAM_WAYS) {
+    wrLine(set, way);
+    tags[set][way] = RAM_NOLINE;
   }
 }
 
-uint8_t SPIRAM::getByte(uint16_t addr) {
-  // Change the buffer
-  chBuffer(addr);
-  // Directly return the byte from the buffer
-  return buf[addr - bufStart];
+// Find the way holding the line, RAM_WAYS if not cached
+uint8_t SPIRAM::findLine(uint16_t tag) {
+  uint8_t set = RAM_SET(tag);
+  for (uint8_t way = 0; way < RAM_WAYS; way++)
+    if (tags[set][way] == tag)
+      return way;
+  return RAM_WAYS;
 }
 
-void SPIRAM::setByte(uint16_t addr, uint8_t data) {
-  // Change the buffer
-  chBuffer(addr);
-  // Directly set the byte into the buffer
-  buf[addr - bufStart] = data;
-  // Mark it dirty
-  bufDirty = true;
+// Bring the line holding the address into the cache, evicting the least
+// recently used line of the set, and make it the most recently used
+uint8_t SPIRAM::chLine(uint16_t addr) {
+  uint8_t set = RAM_SET(addr);
+  uint8_t way = findLine(RAM_TAG(addr));
+  if (way == RAM_WAYS) {
+    // Find the least recently used way
+    for (way = 0; ages[set][way] != RAM_WAYS - 1; way++) { }
+    // Write it back, if dirty, and fill it
+    wrLine(set, way);
+    tags[set][way] = RAM_TAG(addr);
+    rdRAM(tags[set][way], lines[set][way], RAM_LINE_SIZE);
+  }
+  // Age the more recent lines
+  for (uint8_t w = 0; w < RAM_WAYS; w++)
+    if (ages[set][w] < ages[set][way])
+      ages[set][w]++;
+  ages[set][way] = 0;
+  mru[set] = way;
+  return way;
 }
 
-uint16_t SPIRAM::getWord(uint16_t addr) {
-  // Change the buffer
-  chBuffer(addr);
-  // Directly return the byte from the buffer
-  uint16_t bufPos = addr - bufStart;
-  return buf[bufPos] + buf[bufPos + 1] * 0x0100;
+// Refill the fetch buffer starting with the line holding the address;
+// on sequential fetches the lines already there are kept, and only the
+// next ones are read ahead
+uint8_t SPIRAM::chFetch(uint16_t addr) {
+  uint32_t tag = RAM_TAG(addr);
+  uint16_t pos = 0;
+  uint8_t  way;
+  if (tag > iStart and tag < iStart + RAM_FETCH_SIZE) {
+    pos = iStart + RAM_FETCH_SIZE - tag;
+    memmove(iBuf, iBuf + (tag - iStart), pos);
+  }
+  iStart = tag;
+  for (; pos < RAM_FETCH_SIZE; pos += RAM_LINE_SIZE) {
+    // Take the line from the data cache, it may be dirty
+    tag = (uint16_t)(iStart + pos);
+    if ((way = findLine(tag)) < RAM_WAYS)
+      memcpy(iBuf + pos, lines[RAM_SET(tag)][way], RAM_LINE_SIZE);
+    else
+      rdRAM(tag, iBuf + pos, RAM_LINE_SIZE);
+  }
+  return iBuf[addr - iStart];
 }
 
-void SPIRAM::setWord(uint16_t addr, uint16_t data) {
-  // Change the buffer
-  chBuffer(addr);
-  // Directly set the byte into the buffer
-  uint16_t bufPos = addr - bufStart;
-  buf[bufPos]     = lowByte(data);
-  buf[bufPos + 1] = highByte(data);
-  bufDirty = true;
+// Write a line back into RAM, if dirty, and mark it clean
+void SPIRAM::wrLine(uint8_t set, uint8_t way) {
+  if (dirty[set] & (1 << way)) {
+    wrRAM(tags[set][way], lines[set][way], RAM_LINE_SIZE);
+    dirty[set] &= ~(1 << way);
+  }
 }
 
-
 uint8_t SPIRAM::readByte(uint16_t addr) {
   // Begin SPI transfer
   begin();
-  // Command
-  SPI.transfer(CMD_READ);
-  // Address
-  SPI.transfer(0x00);
-  SPI.transfer(highByte(addr));
-  SPI.transfer(lowByte(addr));
+  // Command and address
+  command(CMD_READ, addr);
   // Data
   uint8_t result = SPI.transfer(0x00);
   // End SPI transfer
@@ -182,12 +181,8 @@ uint8_t SPIRAM::readByte(uint16_t addr) {
 void SPIRAM::writeByte(uint16_t addr, uint8_t data) {
   // Begin SPI transfer
   begin();
-  // Command
-  SPI.transfer(CMD_WRITE);
-  // Address
-  SPI.transfer(0x00);
-  SPI.transfer(highByte(addr));
-  SPI.transfer(lowByte(addr));
+  // Command and address
+  command(CMD_WRITE, addr);
   // Data
   SPI.transfer(data);
   // End SPI transfer
@@ -197,12 +192,8 @@ void SPIRAM::writeByte(uint16_t addr, uint8_t data) {
 uint16_t SPIRAM::readWord(uint16_t addr) {
   // Begin SPI transfer
   begin();
-  // Command
-  SPI.transfer(CMD_READ);
-  // Address
-  SPI.transfer(0x00);
-  SPI.transfer(highByte(addr));
-  SPI.transfer(lowByte(addr));
+  // Command and address
+  command(CMD_READ, addr);
   // Data
   uint16_t result = SPI.transfer(0x00) | (SPI.transfer(0x00) << 8);
   // End SPI transfer
@@ -213,12 +204,8 @@ uint16_t SPIRAM::readWord(uint16_t addr) {
 void SPIRAM::writeWord(uint16_t addr, uint16_t data) {
   // Begin SPI transfer
   begin();
-  // Command
-  SPI.transfer(CMD_WRITE);
-  // Address
-  SPI.transfer(0x00);
-  SPI.transfer(highByte(addr));
-  SPI.transfer(lowByte(addr));
+  // Command and address
+  command(CMD_WRITE, addr);
   // Data
   SPI.transfer(lowByte(data));
   SPI.transfer(highByte(data));
@@ -226,36 +213,58 @@ void SPIRAM::writeWord(uint16_t addr, uint16_t data) {
   end();
 }
 
+// Read a block, the dirty cached lines are written back first
 void SPIRAM::read(uint16_t addr, uint8_t *buf, uint16_t len) {
-  uint16_t i = 0;
+  uint8_t way;
+  for (uint32_t tag = RAM_TAG(addr); tag < (uint32_t)addr + len; tag += RAM_LINE_SIZE)
+    if ((way = findLine(tag)) < RAM_WAYS)
+      wrLine(RAM_SET(tag), way);
+  rdRAM(addr, buf, len);
+}
+
+// Write a block, the cached lines and the fetch buffer are updated too
+void SPIRAM::write(uint16_t addr, uint8_t *buf, uint16_t len) {
+  uint8_t way;
+  uint16_t i;
+  for (uint32_t tag = RAM_TAG(addr); tag < (uint32_t)addr + len; tag += RAM_LINE_SIZE)
+    if ((way = findLine(tag)) < RAM_WAYS)
+      for (i = 0; i < RAM_LINE_SIZE; i++)
+        if (tag + i >= addr and tag + i < (uint32_t)addr + len)
+          lines[RAM_SET(tag)][way][i] = buf[tag + i - addr];
+  for (i = 0; i < len; i++)
+    fetchStore(addr + i, buf[i]);
+  wrRAM(addr, buf, len);
+}
+
+void SPIRAM::rdRAM(uint16_t addr, uint8_t *buf, uint16_t len) {
   // Begin SPI transfer
   begin();
-  // Command
-  SPI.transfer(CMD_READ);
-  // Address
-  SPI.transfer(0x00);
-  SPI.transfer(highByte(addr));
-  SPI.transfer(lowByte(addr));
+  // Command and address
+  command(CMD_READ, addr);
   // Data
-  while (len--)
-    buf[i++] = SPI.transfer(0x00);
+#ifdef ESP8266
+  SPI.transferBytes(NULL, buf, len);
+#else
+  memset(buf, 0x00, len);
+  SPI.transfer(buf, len);
+#endif
   // End SPI transfer
   end();
 }
 
-void SPIRAM::write(uint16_t addr, uint8_t *buf, uint16_t len) {
-  uint16_t i = 0;
+void SPIRAM::wrRAM(uint16_t addr, uint8_t *buf, uint16_t len) {
   // Begin SPI transfer
   begin();
-  // Command
-  SPI.transfer(CMD_WRITE);
-  // Address
-  SPI.transfer(0x00);
-  SPI.transfer(highByte(addr));
-  SPI.transfer(lowByte(addr));
+  // Command and address
+  command(CMD_WRITE, addr);
   // Data
-  while (len--)
-    SPI.transfer(buf[i++]);
+#ifdef ESP8266
+  SPI.writeBytes(buf, len);
+#else
+  // The data is not overwritten with the received bytes
+  for (uint16_t i = 0; i < len; i++)
+    SPI.transfer(buf[i]);
+#endif
   // End SPI transfer
   end();
 }
@@ -280,12 +289,8 @@ void SPIRAM::hexdump(uint16_t start, uint16_t stop, char* comment) {
   }
   // Begin SPI transfer
   begin();
-  // Command
-  SPI.transfer(CMD_READ);
-  // Address
-  SPI.transfer(0x00);
-  SPI.transfer(highByte(start));
-  SPI.transfer(lowByte(start));
+  // Command and address
+  command(CMD_READ, start);
   // All bytes
   for (uint16_t addr = start; addr <= stop;) {
     yield();
@@ -322,6 +327,16 @@ void SPIRAM::hexdump(uint16_t start, uint16_t stop, char* comment) {
 }
 
 
+// Send the command and the 24 bits address
+void SPIRAM::command(uint8_t cmd, uint16_t addr) {
+  uint8_t hdr[4] = {cmd, 0x00, highByte(addr), lowByte(addr)};
+#ifdef ESP8266
+  SPI.writeBytes(hdr, 4);
+#else
+  SPI.transfer(hdr, 4);
+#endif
+}
+
 void SPIRAM::begin() {
   SPI.beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE0));
   digitalWrite(cs, LOW);
@@ -35,9 +35,24 @@ enum SPIRAM_CMNDS {CMD_WRMR  = 0x01, CMD_RDMR = 0x05,
 enum SPIRAM_MODES {MODE_BYTE = 0x00, MODE_SEQ = 0x40, MODE_PAGE = 0x80};
 
 
+// Cache set and line address of a memory address
+#define RAM_SET(addr)   (((addr) / RAM_LINE_SIZE) & (RAM_SETS - 1))
+#define RAM_TAG(addr)   ((addr) & ~(RAM_LINE_SIZE - 1))
+#define RAM_OFS(addr)   ((addr) & (RAM_LINE_SIZE - 1))
+// Tag of an empty line (never aligned)
+#define RAM_NOLINE      (0xFFFF)
+// Instruction fetch buffer size, start address when empty
+#define RAM_FETCH_SIZE  (RAM_FETCH_LINES * RAM_LINE_SIZE)
+#define RAM_NOFETCH     (0x20000UL)
+
+#if RAM_WAYS > 8
+#error "At most 8 ways per cache set (RAM_WAYS)"
+#endif
+
+
 class SPIRAM {
   public:
-    SPIRAM(int CS = SS, uint16_t bufSize = 16);
+    SPIRAM(int CS = SS);
     ~SPIRAM();
     void      init();
     void      clear();
@@ -46,6 +61,7 @@ class SPIRAM {
     void      flush(uint16_t addr);
     uint8_t   getByte(uint16_t addr);
     void      setByte(uint16_t addr, uint8_t data);
+    uint8_t   fetch(uint16_t addr);
     uint16_t  getWord(uint16_t addr);
     void      setWord(uint16_t addr, uint16_t data);
     uint8_t   readByte(uint16_t addr);
@@ -54,27 +70,107 @@ class SPIRAM {
     void      writeWord(uint16_t addr, uint16_t data);
     void      read(uint16_t addr, uint8_t *buf, uint16_t len);
     void      write(uint16_t addr, uint8_t *buf, uint16_t len);
+    uint8_t*  span(uint16_t addr, uint16_t len);
     void      hexdump(uint16_t start = 0x0000, uint16_t stop = LASTBYTE, char* comment = "");
 
   private:
     // SPI transactions
-    void begin();
-    void end();
-    bool inBuffer(uint16_t addr);
+    void      begin();
+    void      end();
+    void      command(uint8_t cmd, uint16_t addr);
+    void      rdRAM(uint16_t addr, uint8_t *buf, uint16_t len);
+    void      wrRAM(uint16_t addr, uint8_t *buf, uint16_t len);
 
     // Chip select
     int cs;
 
-    // Buffer
-    void      chBuffer(uint16_t addr);
-    void      rdBuffer();
-    void      wrBuffer();
-    uint8_t*  buf;
-    bool      bufDirty = false;
-    uint16_t  bufSize = 0;
-    uint16_t  bufHalfSize = 0;
-    uint16_t  bufStart = LASTBYTE;
-    uint16_t  bufEnd = LASTBYTE;
+    // Cache, RAM_SETS sets of RAM_WAYS lines of RAM_LINE_SIZE bytes
+    uint8_t*  getLine(uint16_t addr);
+    uint8_t   chLine(uint16_t addr);
+    uint8_t   findLine(uint16_t tag);
+    void      wrLine(uint8_t set, uint8_t way);
+    void      invalidate();
+    uint8_t   lines[RAM_SETS][RAM_WAYS][RAM_LINE_SIZE];
+    uint16_t  tags[RAM_SETS][RAM_WAYS];   // Line addresses
+    uint8_t   ages[RAM_SETS][RAM_WAYS];   // LRU order, 0 is the most recent
+    uint8_t   mru[RAM_SETS];              // Most recently used way
+    uint8_t   dirty[RAM_SETS];            // Dirty lines, one bit per way
+
+    // Instruction fetch buffer, RAM_FETCH_LINES consecutive lines
+    uint8_t   chFetch(uint16_t addr);
+    void      fetchStore(uint16_t addr, uint8_t data);
+    uint8_t   iBuf[RAM_FETCH_SIZE];
+    uint32_t  iStart = RAM_NOFETCH;
 };
 
+// The cache hit path is inlined into the CPU core
+
+// Get the cached line holding the address, the set MRU line is checked first
+inline uint8_t* SPIRAM::getLine(uint16_t addr) {
+  uint8_t set = RAM_SET(addr);
+  uint8_t way = mru[set];
+  if (tags[set][way] != RAM_TAG(addr))
+    way = chLine(addr);
+  return lines[set][way];
+}
+
+inline uint8_t SPIRAM::getByte(uint16_t addr) {
+  // Directly return the byte from the line
+  return getLine(addr)[RAM_OFS(addr)];
+}
+
+inline void SPIRAM::setByte(uint16_t addr, uint8_t data) {
+  // Directly set the byte into the line
+  getLine(addr)[RAM_OFS(addr)] = data;
+  // Mark it dirty
+  dirty[RAM_SET(addr)] |= 1 << mru[RAM_SET(addr)];
+  // Keep the fetch buffer coherent
+  fetchStore(addr, data);
+}
+
+// No direct access, the memory is behind the SPI bus
+inline uint8_t* SPIRAM::span(uint16_t addr, uint16_t len) {
+  return NULL;
+}
+
+// Instruction fetch, through its own buffer
+inline uint8_t SPIRAM::fetch(uint16_t addr) {
+  if ((uint32_t)addr - iStart < RAM_FETCH_SIZE)
+    return iBuf[addr - iStart];
+  return chFetch(addr);
+}
+
+// Update the fetch buffer on stores
+inline void SPIRAM::fetchStore(uint16_t addr, uint8_t data) {
+  if ((uint32_t)addr - iStart < RAM_FETCH_SIZE)
+    iBuf[addr - iStart] = data;
+}
+
+inline uint16_t SPIRAM::getWord(uint16_t addr) {
+  // The word may span two lines
+  if (RAM_OFS(addr) == RAM_LINE_SIZE - 1)
+    return getByte(addr) + getByte(addr + 1) * 0x0100;
+  // Directly return the word from the line
+  uint8_t *line = getLine(addr) + RAM_OFS(addr);
+  return line[0] + line[1] * 0x0100;
+}
+
+inline void SPIRAM::setWord(uint16_t addr, uint16_t data) {
+  // The word may span two lines
+  if (RAM_OFS(addr) == RAM_LINE_SIZE - 1) {
+    setByte(addr,     lowByte(data));
+    setByte(addr + 1, highByte(data));
+    return;
+  }
+  // Directly set the word into the line
+  uint8_t *line = getLine(addr) + RAM_OFS(addr);
+  line[0] = lowByte(data);
+  line[1] = highByte(data);
+  // Mark it dirty
+  dirty[RAM_SET(addr)] |= 1 << mru[RAM_SET(addr)];
+  // Keep the fetch buffer coherent
+  fetchStore(addr,     lowByte(data));
+  fetchStore(addr + 1, highByte(data));
+}
+
 #endif /* SPIRAM_H */
@@ -0,0 +1,31 @@
+/**
+  Arduino.h - Host stubs for the CPU benchmark
+
+  Only what i8080.cpp and mcuram.cpp need.
+*/
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)       (s)
+#define F(s)          (s)
+#define sprintf_P     sprintf
+#define lowByte(w)    ((uint8_t)((w) & 0xFF))
+#define highByte(w)   ((uint8_t)((w) >> 8))
+
+inline void yield() {}
+
+struct SerialStub {
+  template<class T> size_t print(T) { return 0; }
+  size_t println() { return 0; }
+  size_t write(char) { return 1; }
+};
+extern SerialStub Serial;
+
+#endif /* ARDUINO_H */
@@ -0,0 +1,73 @@
+/**
+  cpu_bench.cpp - Measure the 8080 core throughput on the host
+
+  Runs a memory fill and a checksum loop, with calls, in batches of
+  CPU_BUDGET cycles, as the main loop does, and prints the emulated
+  clock rate.
+*/
+
+#include <chrono>
+#include <stdlib.h>
+#include "mcuram.h"
+#include "i8080.h"
+
+SerialStub Serial;
+MCURAM ram;
+I8080 cpu(&ram);
+
+int  I8080::io_input(int port) {
+  return 0x00;
+}
+void I8080::io_output(int port, int value) {
+}
+void I8080::iff(int on) {
+  state = 0;
+}
+
+// The benchmark program, at 0x0100
+static const uint8_t code[] = {
+  0x31, 0x00, 0x80,       // 0100  LXI SP,8000H
+  0x21, 0x00, 0x20,       // 0103  LXI H,2000H      ; fill 4K
+  0x01, 0x00, 0x10,       // 0106  LXI B,1000H
+  0x7D,                   // 0109  MOV A,L
+  0x84,                   // 010A  ADD H
+  0x77,                   // 010B  MOV M,A
+  0x23,                   // 010C  INX H
+  0x0B,                   // 010D  DCX B
+  0x78,                   // 010E  MOV A,B
+  0xB1,                   // 010F  ORA C
+  0xC2, 0x09, 0x01,       // 0110  JNZ 0109H
+  0x21, 0x00, 0x20,       // 0113  LXI H,2000H      ; checksum it
+  0x11, 0x00, 0x10,       // 0116  LXI D,1000H
+  0xAF,                   // 0119  XRA A
+  0xCD, 0x30, 0x01,       // 011A  CALL 0130H
+  0x1B,                   // 011D  DCX D
+  0x47,                   // 011E  MOV B,A
+  0x7A,                   // 011F  MOV A,D
+  0xB3,                   // 0120  ORA E
+  0x78,                   // 0121  MOV A,B
+  0xC2, 0x1A, 0x01,       // 0122  JNZ 011AH
+  0x32, 0x00, 0x30,       // 0125  STA 3000H
+  0xC3, 0x03, 0x01,       // 0128  JMP 0103H
+  0x00, 0x00, 0x00, 0x00, 0x00,
+  0x86,                   // 0130  ADD M
+  0x17,                   // 0131  RAL
+  0x23,                   // 0132  INX H
+  0xC9,                   // 0133  RET
+};
+
+int main(int argc, char **argv) {
+  uint32_t batches = argc > 1 ? atol(argv[1]) : 50000;
+  ram.init();
+  ram.write(0x0100, (uint8_t*)code, sizeof(code));
+  cpu.init();
+  cpu.jump(0x0100);
+  double total = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t k = 0; k < batches; k++)
+    total += cpu.run(CPU_BUDGET);
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+  printf("%.0f cycles in %.3f s, %.1f MHz, checksum %02X\n",
+         total, secs.count(), total / secs.count() / 1e6, ram.getByte(0x3000));
+  return 0;
+}
@@ -0,0 +1,38 @@
+/**
+  Arduino.h - Host stubs for the SPI RAM test
+
+  Only what spiram.cpp needs, the chip select goes to the simulated
+  SPI RAM chip.
+*/
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)       (s)
+#define F(s)          (s)
+#define sprintf_P     sprintf
+#define lowByte(w)    ((uint8_t)((w) & 0xFF))
+#define highByte(w)   ((uint8_t)((w) >> 8))
+
+#define HIGH          (1)
+#define LOW           (0)
+#define OUTPUT        (1)
+#define SS            (15)
+
+inline void yield() {}
+inline void delay(unsigned long) {}
+inline void pinMode(int, int) {}
+void digitalWrite(int pin, int level);
+
+struct SerialStub {
+  template<class T> size_t print(T) { return 0; }
+  size_t write(char) { return 1; }
+};
+extern SerialStub Serial;
+
+#endif /* ARDUINO_H */
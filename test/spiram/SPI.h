@@ -0,0 +1,120 @@
+/**
+  SPI.h - Simulated SPI RAM chip (23LC1024) on a host SPI bus
+
+  The chip decodes the command, the 24 bits address and the data bytes
+  of each chip select transaction, in sequential mode, over 128KB of
+  flat memory.  Any framing error is counted.
+*/
+
+#ifndef SPI_H
+#define SPI_H
+
+#include <Arduino.h>
+
+#define MSBFIRST      (1)
+#define SPI_MODE0     (0)
+
+struct SPISettings {
+  SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+class SPIClass {
+  public:
+    uint8_t   mem[0x20000];       // Chip memory
+    uint8_t   mode = 0x40;        // Mode register, sequential
+    uint32_t  errors = 0;         // Framing errors
+    uint32_t  frames = 0;         // Chip select transactions
+
+    void beginTransaction(SPISettings) {
+      inTrans = true;
+    }
+    void endTransaction() {
+      if (selected)
+        errors++;
+      inTrans = false;
+    }
+    // Chip select
+    void select(bool on) {
+      if (on == selected or (on and not inTrans))
+        errors++;
+      // A read or write needs its full address
+      if (not on and (cmd == 0x02 or cmd == 0x03) and count < 4)
+        errors++;
+      selected = on;
+      cmd = 0;
+      count = 0;
+      if (on)
+        frames++;
+    }
+
+    uint8_t transfer(uint8_t data) {
+      return clock(data);
+    }
+    void transfer(void *buf, uint16_t len) {
+      uint8_t *b = (uint8_t*)buf;
+      for (uint16_t i = 0; i < len; i++)
+        b[i] = clock(b[i]);
+    }
+#ifdef ESP8266
+    void transferBytes(const uint8_t *out, uint8_t *in, uint32_t len) {
+      for (uint32_t i = 0; i < len; i++) {
+        uint8_t data = clock(out ? out[i] : 0xFF);
+        if (in)
+          in[i] = data;
+      }
+    }
+    void writeBytes(const uint8_t *data, uint32_t len) {
+      for (uint32_t i = 0; i < len; i++)
+        clock(data[i]);
+    }
+    void writePattern(const uint8_t *data, uint8_t size, uint32_t repeat) {
+      for (uint32_t r = 0; r < repeat; r++)
+        writeBytes(data, size);
+    }
+#endif
+
+  private:
+    bool      inTrans = false;
+    bool      selected = false;
+    uint8_t   cmd = 0;
+    uint32_t  count = 0;
+    uint32_t  addr = 0;
+
+    // One byte in each direction
+    uint8_t clock(uint8_t data) {
+      uint8_t result = 0xFF;
+      if (not selected) {
+        errors++;
+        return result;
+      }
+      if (count == 0) {
+        cmd = data;
+        addr = 0;
+        if (cmd != 0x01 and cmd != 0x02 and cmd != 0x03 and cmd != 0x05 and cmd != 0xFF)
+          errors++;
+      }
+      else if (cmd == 0x01)
+        mode = data;
+      else if (cmd == 0x05)
+        result = mode;
+      else if (cmd == 0xFF)
+        errors++;
+      else if (count < 4)
+        addr = (addr << 8) | data;
+      else {
+        if (count == 4 and addr > 0x1FFFF)
+          errors++;
+        if (cmd == 0x02)
+          mem[addr & 0x1FFFF] = data;
+        else
+          result = mem[addr & 0x1FFFF];
+        addr = (addr + 1) & 0x1FFFF;
+      }
+      count++;
+      return result;
+    }
+};
+
+extern SPIClass SPI;
+
+#endif /* SPI_H */
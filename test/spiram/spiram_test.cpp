@@ -0,0 +1,118 @@
+/**
+  spiram_test.cpp - Check the SPI RAM transfers against flat memory
+
+  The SPIRAM class talks to a simulated chip (SPI.h), every block
+  transfer, line fill, write-back and clear is checked both for its
+  framing and its data.
+*/
+
+#include <stdlib.h>
+#include "spiram.h"
+
+SPIClass SPI;
+SerialStub Serial;
+
+// The chip select goes to the simulated chip
+void digitalWrite(int pin, int level) {
+  if (pin == SS)
+    SPI.select(level == LOW);
+}
+
+static uint8_t mirror[0x10000];
+static int fails = 0;
+
+#define CHECK(c) do { if (not (c)) { printf("FAIL %s:%d %s\n", __FILE__, __LINE__, #c); fails++; } } while (0)
+
+// The chip holds the same data as the mirror
+static bool same() {
+  return memcmp(SPI.mem, mirror, sizeof(mirror)) == 0;
+}
+
+int main() {
+  static SPIRAM ram(SS);
+  uint8_t buf[600], chk[600];
+  // The power-on chip select pulse is not a transaction
+  CHECK(SPI.frames == 1);
+  SPI.errors = 0;
+  srand(8080);
+  ram.init();
+  CHECK(SPI.mode == MODE_SEQ);
+
+  // Clear
+  memset(SPI.mem, 0xAA, sizeof(SPI.mem));
+  ram.clear();
+  CHECK(same());
+  CHECK(SPI.mem[0x10000] == 0xAA);
+
+  // Block writes and reads, any address and length
+  for (int k = 0; k < 2000; k++) {
+    uint16_t len  = rand() % sizeof(buf) + 1;
+    uint16_t addr = rand() % (0x10000 - len);
+    for (uint16_t i = 0; i < len; i++)
+      buf[i] = mirror[addr + i] = rand();
+    ram.write(addr, buf, len);
+    addr = rand() % (0x10000 - len);
+    ram.read(addr, chk, len);
+    CHECK(memcmp(chk, mirror + addr, len) == 0);
+  }
+  CHECK(same());
+
+  // Line fills and write-backs, mixed with block transfers
+  for (int k = 0; k < 200000; k++) {
+    uint16_t addr = rand();
+    switch (rand() % 8) {
+      case 0:
+        mirror[addr] = rand();
+        ram.setByte(addr, mirror[addr]);
+        break;
+      case 1:
+        mirror[addr] = rand();
+        mirror[(uint16_t)(addr + 1)] = rand();
+        ram.setWord(addr, mirror[addr] | mirror[(uint16_t)(addr + 1)] << 8);
+        break;
+      case 2:
+        CHECK(ram.getWord(addr) == (mirror[addr] | mirror[(uint16_t)(addr + 1)] << 8));
+        break;
+      case 3:
+        CHECK(ram.fetch(addr) == mirror[addr]);
+        break;
+      case 4:
+        if (addr <= 0x10000 - 128) {
+          ram.read(addr, chk, 128);
+          CHECK(memcmp(chk, mirror + addr, 128) == 0);
+        }
+        break;
+      case 5:
+        if (addr <= 0x10000 - 128) {
+          for (uint16_t i = 0; i < 128; i++)
+            buf[i] = mirror[addr + i] = rand();
+          ram.write(addr, buf, 128);
+        }
+        break;
+      default:
+        CHECK(ram.getByte(addr) == mirror[addr]);
+    }
+  }
+  ram.flush();
+  CHECK(same());
+
+  // Single bytes and words, straight to the chip
+  ram.writeByte(0x1234, 0x5A);
+  ram.writeWord(0xFFF0, 0xBEEF);
+  CHECK(ram.readByte(0x1234) == 0x5A);
+  CHECK(ram.readWord(0xFFF0) == 0xBEEF);
+  CHECK(SPI.mem[0xFFF0] == 0xEF and SPI.mem[0xFFF1] == 0xBE);
+
+  // Clear, after all that
+  ram.clear();
+  memset(mirror, 0, sizeof(mirror));
+  CHECK(same());
+  CHECK(ram.getByte(0x1234) == 0x00);
+
+  CHECK(SPI.errors == 0);
+  if (fails)
+    printf("FAILED %d\n", fails);
+  else
+    printf("OK, %lu transactions\n", (unsigned long)SPI.frames);
+  return fails != 0;
+}